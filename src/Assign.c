@@ -4,341 +4,253 @@
 
 #include <assert.h>
 #include <memory.h>
+#include <stdint.h>
 #include <tribble/tribble.h>
 
-enum {
-	NONE,
-	MARK,
-	PRIME
-};
-
-static void __hungarian_reduce_rows(u32 ngoals, u32 (*table)[ngoals][ngoals])
+HungarianScratch *hungarian_scratch_init(HungarianScratch *scratch, u32 ngoals)
 {
-	for (u32 i = 0; i < ngoals; ++i) {
-		u32 lowest = (*table)[i][0];
+	scratch->ngoals = ngoals;
 
-		for (u32 j = 1; j < ngoals; ++j) {
-			if ((*table)[i][j] < lowest)
-				lowest = (*table)[i][j];
-		}
+	scratch->owner = malloc(ngoals * sizeof(u32));
+	assert(scratch->owner != NULL);
 
-		for (u32 j = 0; j < ngoals; ++j) {
-			(*table)[i][j] -= lowest;
-		}
-	}
-}
+	scratch->prev = malloc(ngoals * sizeof(u32));
+	assert(scratch->prev != NULL);
 
-static void __hungarian_reduce_cols(u32 ngoals, u32 (*table)[ngoals][ngoals])
-{
-	for (u32 j = 0; j < ngoals; ++j) {
-		u32 lowest = (*table)[0][j];
+	scratch->dist = malloc(ngoals * sizeof(i64));
+	assert(scratch->dist != NULL);
 
-		for (u32 i = 1; i < ngoals; ++i) {
-			if ((*table)[i][j] < lowest)
-				lowest = (*table)[i][j];
-		}
+	scratch->done = malloc(ngoals);
+	assert(scratch->done != NULL);
 
-		if (lowest == 0)
-			continue;
-
-		for (u32 i = 0; i < ngoals; ++i) {
-			(*table)[i][j] -= lowest;
-		}
-	}
+	return scratch;
 }
 
-static void __hungarian_mark(u32 ngoals, u32 (*table)[ngoals][ngoals], u8 (*marks)[ngoals][ngoals])
+void hungarian_scratch_destroy(HungarianScratch *scratch)
 {
-	memset(marks, 0, sizeof *marks);
-
-	u8 covered_rows[ngoals];
-	memset(covered_rows, 0, ngoals);
-
-	u8 covered_cols[ngoals];
-	memset(covered_cols, 0, ngoals);
-
-	for (u32 i = 0; i < ngoals; ++i) {
-		for (u32 j = 0; j < ngoals; ++j) {
-			if (covered_rows[i] || covered_cols[j])
-				break;
-
-			if ((*table)[i][j] == 0) {
-				(*marks)[i][j] = MARK;
-				covered_rows[i] = 1;
-				covered_cols[j] = 1;
-			}
-		}
-	}
+	free(scratch->owner);
+	free(scratch->prev);
+	free(scratch->dist);
+	free(scratch->done);
 }
 
-static u32 __hungarian_count_covered(
+/*
+ * Finds the shortest path in the reduced costs from the free goal to a free
+ * box and flips the matching along it. The potentials are shifted so that
+ * every reduced cost stays non-negative and every matched pair stays tight.
+ * Returns FALSE when no free box can be reached over finite distances.
+ */
+static bool __hungarian_augment(
+	HungarianScratch *scratch,
 	u32 ngoals,
-	u8 (*marks)[ngoals][ngoals],
-	u8 covered_rows[ngoals],
-	u8 covered_cols[ngoals]
+	u32 (*distances)[ngoals][ngoals],
+	u32 root,
+	i32 *goal_pot,
+	i32 *box_pot,
+	u32 *matching
 )
 {
-	u32 count = 0;
+	u32 *owner = scratch->owner;
+	u32 *prev = scratch->prev;
+	i64 *dist = scratch->dist;
+	u8 *done = scratch->done;
 
-	for (u32 i = 0; i < ngoals; ++i) {
-		for (u32 j = 0; j < ngoals; ++j) {
-			if ((covered_rows[i] || covered_cols[j]) && ((*marks)[i][j] == MARK))
-				count++;
-		}
+	assert(ngoals <= scratch->ngoals);
+
+	for (u32 box = 0; box < ngoals; ++box) {
+		owner[box] = U32_MAX;
+		dist[box] = INT64_MAX;
+		done[box] = 0;
 	}
 
-	return count;
-}
+	for (u32 goal = 0; goal < ngoals; ++goal) {
+		if (matching[goal] != U32_MAX)
+			owner[matching[goal]] = goal;
+	}
 
-static void __hungarian_cover_cols(u32 ngoals, u8 (*marks)[ngoals][ngoals], u8 covered_cols[ngoals])
-{
-	for (u32 i = 0; i < ngoals; ++i) {
+	u32 goal = root;
+	u32 box = U32_MAX;
+	i64 delta = 0;
+
+	while (1) {
 		for (u32 j = 0; j < ngoals; ++j) {
-			if ((*marks)[i][j] == MARK) {
-				covered_cols[j] = 1;
+			if (done[j] || (*distances)[goal][j] == U32_MAX)
+				continue;
+
+			i64 d = delta + (*distances)[goal][j] - goal_pot[goal] - box_pot[j];
+
+			if (d < dist[j]) {
+				dist[j] = d;
+				prev[j] = goal;
 			}
 		}
-	}
-}
 
-static bool __hungarian_find_prime(
-	u32 ngoals,
-	u32 (*table)[ngoals][ngoals],
-	u8 (*marks)[ngoals][ngoals],
-	u8 covered_rows[ngoals],
-	u8 covered_cols[ngoals],
-	u32 *prime_row,
-	u32 *prime_col
-)
-{
-	for (u32 i = 0; i < ngoals; ++i) {
-		u32 mark_col = U32_MAX;
+		box = U32_MAX;
 
 		for (u32 j = 0; j < ngoals; ++j) {
-			if ((*marks)[i][j] == MARK) {
-				mark_col = j;
-				continue;
-			}
+			if (!done[j] && dist[j] != INT64_MAX && (box == U32_MAX || dist[j] < dist[box]))
+				box = j;
+		}
 
-			if (covered_cols[j])
-				continue;
+		if (box == U32_MAX)
+			return FALSE;
 
-			if ((*table)[i][j] != 0)
-				continue;
+		delta = dist[box];
+		done[box] = 1;
 
-			(*marks)[i][j] = PRIME;
+		if (owner[box] == U32_MAX)
+			break;
 
-			if (mark_col != U32_MAX) {
-				covered_rows[i] = 1;
-				covered_cols[mark_col] = 0;
-				continue;
-			}
+		goal = owner[box];
+	}
 
-			*prime_row = i;
-			*prime_col = j;
+	for (u32 j = 0; j < ngoals; ++j) {
+		if (!done[j])
+			continue;
 
-			return TRUE;
-		}
+		i32 shift = delta - dist[j];
+		box_pot[j] -= shift;
+
+		if (owner[j] != U32_MAX)
+			goal_pot[owner[j]] += shift;
 	}
 
-	return FALSE;
-}
+	goal_pot[root] += delta;
 
-static void __hungarian_alt_marks(
-	u32 ngoals,
-	u8 (*marks)[ngoals][ngoals],
-	u32 prime_row,
-	u32 prime_col
-)
-{
 	while (1) {
-		u32 mark_col = prime_col;
-		u32 mark_row = U32_MAX;
+		goal = prev[box];
 
-		for (u32 i = 0; i < ngoals; ++i) {
-			if (i == prime_row)
-				continue;
+		u32 next = matching[goal];
+		matching[goal] = box;
 
-			if ((*marks)[i][prime_col] == MARK) {
-				mark_row = i;
-				break;
-			}
-		}
+		if (goal == root)
+			break;
 
-		(*marks)[prime_row][prime_col] = MARK;
+		box = next;
+	}
 
-		if (mark_row == U32_MAX)
-			break;
+	return TRUE;
+}
 
-		(*marks)[mark_row][mark_col] = NONE;
+static u32 __hungarian_cost(u32 ngoals, u32 (*distances)[ngoals][ngoals], u32 *matching)
+{
+	u32 total = 0;
 
-		for (u32 j = 0; j < ngoals; ++j) {
-			if (j == prime_col)
-				continue;
+	for (u32 goal = 0; goal < ngoals; ++goal)
+		total += (*distances)[goal][matching[goal]];
 
-			if ((*marks)[mark_row][j] == PRIME) {
-				prime_row = mark_row;
-				prime_col = j;
-				break;
-			}
-		}
-	}
+	return total;
 }
 
-static void __hungarian_add_and_subtract(
+/*
+ * Solves the assignment with one shortest augmenting path per goal, O(n^3) in
+ * total, leaving the matching and the potentials proving it optimal for later
+ * updates. Returns the cost of the matching, or U32_MAX if the boxes can't be
+ * matched with the goals at all.
+ */
+u32 hungarian_assignment(
+	HungarianScratch *scratch,
 	u32 ngoals,
-	u32 (*table)[ngoals][ngoals],
-	u8 covered_rows[ngoals],
-	u8 covered_cols[ngoals]
+	u32 (*distances)[ngoals][ngoals],
+	i32 *goal_pot,
+	i32 *box_pot,
+	u32 *matching
 )
 {
-	u32 lowest = U32_MAX;
-
-	for (u32 i = 0; i < ngoals; ++i) {
-		if (covered_rows[i])
-			continue;
+	for (u32 goal = 0; goal < ngoals; ++goal) {
+		goal_pot[goal] = 0;
+		matching[goal] = U32_MAX;
+	}
 
-		for (u32 j = 0; j < ngoals; ++j) {
-			if (covered_cols[j])
-				continue;
+	for (u32 box = 0; box < ngoals; ++box) {
+		u32 lowest = U32_MAX;
 
-			if ((*table)[i][j] < lowest) {
-				lowest = (*table)[i][j];
-			}
+		for (u32 goal = 0; goal < ngoals; ++goal) {
+			if ((*distances)[goal][box] < lowest)
+				lowest = (*distances)[goal][box];
 		}
+
+		box_pot[box] = lowest == U32_MAX ? 0 : lowest;
 	}
 
-	for (u32 i = 0; i < ngoals; ++i) {
-		for (u32 j = 0; j < ngoals; ++j) {
-			if (!covered_rows[i] && !covered_cols[j])
-				(*table)[i][j] -= lowest;
-			else if (covered_rows[i] && covered_cols[j])
-				(*table)[i][j] += lowest;
-		}
+	for (u32 goal = 0; goal < ngoals; ++goal) {
+		if (!__hungarian_augment(scratch, ngoals, distances, goal, goal_pot, box_pot, matching))
+			return U32_MAX;
 	}
+
+	return __hungarian_cost(ngoals, distances, matching);
 }
 
-/* Used for debugging */
-TRB_UNUSED static void __hungarian_print_table(
+/*
+ * Repairs an optimal matching after the distances of a single box changed.
+ * The box is unmatched, its potential is lowered or raised to the tightest
+ * feasible value, and a single augmenting path matches its goal again.
+ */
+u32 hungarian_update(
+	HungarianScratch *scratch,
 	u32 ngoals,
-	u32 (*table)[ngoals][ngoals],
-	u8 (*marks)[ngoals][ngoals],
-	u8 covered_rows[ngoals],
-	u8 covered_cols[ngoals]
+	u32 (*distances)[ngoals][ngoals],
+	u32 box,
+	i32 *goal_pot,
+	i32 *box_pot,
+	u32 *matching
 )
 {
-	for (u32 i = 0; i < ngoals; ++i) {
-		for (u32 j = 0; j < ngoals; ++j) {
-			if (covered_rows[i] || covered_cols[j]) {
-				printf("\e[30;47m");
-			}
+	u32 root = U32_MAX;
+	i64 lowest = INT64_MAX;
 
-			if (marks != NULL && (*marks)[i][j]) {
-				if ((*marks)[i][j] == MARK)
-					printf("%4d*", (*table)[i][j]);
-				else if ((*marks)[i][j] == PRIME)
-					printf("%4d'", (*table)[i][j]);
-			} else {
-				printf("%4d ", (*table)[i][j]);
-			}
-
-			if (covered_rows[i] || covered_cols[j]) {
-				printf("\e[0m");
-			}
-		}
+	for (u32 goal = 0; goal < ngoals; ++goal) {
+		if (matching[goal] == box)
+			root = goal;
 
-		printf("\n");
+		if ((*distances)[goal][box] != U32_MAX && (i64) (*distances)[goal][box] - goal_pot[goal] < lowest)
+			lowest = (i64) (*distances)[goal][box] - goal_pot[goal];
 	}
-}
-
-u32 *hungarian_assignment(u32 ngoals, u32 (*distances)[ngoals][ngoals])
-{
-	u8 covered_rows[ngoals];
-	memset(covered_rows, 0, ngoals);
-
-	u8 covered_cols[ngoals];
-	memset(covered_cols, 0, ngoals);
-
-	u32(*table)[ngoals][ngoals] = malloc(sizeof *table);
-	assert(table != NULL);
 
-	memcpy(table, distances, sizeof *table);
+	if (lowest == INT64_MAX)
+		return U32_MAX;
 
-	__hungarian_reduce_rows(ngoals, table);
-	__hungarian_reduce_cols(ngoals, table);
+	matching[root] = U32_MAX;
+	box_pot[box] = lowest;
 
-	u8(*marks)[ngoals][ngoals] = malloc(sizeof *marks);
-	assert(marks != NULL);
+	if (!__hungarian_augment(scratch, ngoals, distances, root, goal_pot, box_pot, matching))
+		return U32_MAX;
 
-	__hungarian_mark(ngoals, table, marks);
-
-	while (1) {
-		__hungarian_cover_cols(ngoals, marks, covered_cols);
-
-		u32 n_covered = __hungarian_count_covered(ngoals, marks, covered_rows, covered_cols);
-		if (n_covered == ngoals)
-			break;
-
-		u32 prime_row, prime_col;
-
-		while (1) {
-			bool found_prime = __hungarian_find_prime(
-				ngoals, table, marks,
-				covered_rows, covered_cols,
-				&prime_row, &prime_col
-			);
-
-			if (found_prime)
-				break;
-
-			__hungarian_add_and_subtract(ngoals, table, covered_rows, covered_cols);
-		}
-
-		__hungarian_alt_marks(ngoals, marks, prime_row, prime_col);
-
-		memset(covered_rows, 0, ngoals);
-		memset(covered_cols, 0, ngoals);
-	}
+	return __hungarian_cost(ngoals, distances, matching);
+}
 
-	u32 *matching = malloc(ngoals * sizeof(u32));
-	assert(matching != NULL);
+ClosestScratch *closest_scratch_init(ClosestScratch *scratch, u32 ngoals)
+{
+	scratch->ngoals = ngoals;
 
-	for (u32 i = 0; i < ngoals; ++i)
-		for (u32 j = 0; j < ngoals; ++j)
-			if ((*marks)[i][j] == MARK)
-				matching[i] = j;
+	scratch->unmatched = malloc(ngoals * sizeof(u32));
+	assert(scratch->unmatched != NULL);
 
-	free(table);
-	free(marks);
+	return scratch;
+}
 
-	return matching;
+void closest_scratch_destroy(ClosestScratch *scratch)
+{
+	free(scratch->unmatched);
 }
 
-u32 *closest_assignment(u32 ngoals, u32 (*distances)[ngoals][ngoals])
+void closest_assignment(ClosestScratch *scratch, u32 ngoals, u32 (*distances)[ngoals][ngoals], u32 *matching)
 {
-	u32 *matching = malloc(ngoals * sizeof(u32));
-	assert(matching != NULL);
+	u32 *unmatched = scratch->unmatched;
+	u32 nunmatched = ngoals;
 
-	TrbVector unmatched_boxes;
-	trb_vector_init(&unmatched_boxes, TRUE, 4);
-	for (u32 box = 0; box < ngoals; ++box) {
-		trb_vector_push_back(&unmatched_boxes, trb_get_ptr(u32, box));
-	}
+	assert(ngoals <= scratch->ngoals);
 
-	TrbVector unmatched_goals;
-	trb_vector_init(&unmatched_goals, TRUE, 4);
-	for (u32 goal = 0; goal < ngoals; ++goal) {
-		trb_vector_push_back(&unmatched_goals, trb_get_ptr(u32, goal));
-	}
+	for (u32 box = 0; box < ngoals; ++box)
+		unmatched[box] = box;
 
-	for (u32 i = 0; i < unmatched_goals.len; ++i) {
-		u32 goal = trb_vector_get(&unmatched_goals, u32, i);
+	for (u32 goal = 0; goal < ngoals; ++goal) {
 		u32 closest_j = 0;
-		u32 closest_box = trb_vector_get(&unmatched_boxes, u32, 0);
+		u32 closest_box = unmatched[0];
 		u32 closest_dist = (*distances)[goal][closest_box];
 
-		for (u32 j = 1; j < unmatched_boxes.len; ++j) {
-			u32 box = trb_vector_get(&unmatched_boxes, u32, j);
+		for (u32 j = 1; j < nunmatched; ++j) {
+			u32 box = unmatched[j];
 			u32 dist = (*distances)[goal][box];
 
 			if (dist > closest_dist) {
@@ -348,89 +260,78 @@ u32 *closest_assignment(u32 ngoals, u32 (*distances)[ngoals][ngoals])
 			}
 		}
 
-		trb_vector_remove(&unmatched_boxes, closest_j, NULL);
+		/* The remaining boxes keep their order */
+		memmove(unmatched + closest_j, unmatched + closest_j + 1, (--nunmatched - closest_j) * sizeof(u32));
 		matching[goal] = closest_box;
 	}
+}
+
+GreedyScratch *greedy_scratch_init(GreedyScratch *scratch, u32 ngoals)
+{
+	scratch->ngoals = ngoals;
+
+	scratch->edges = malloc(ngoals * ngoals * sizeof(Edge));
+	assert(scratch->edges != NULL);
+
+	scratch->matched_goals = malloc((ngoals + 63) / 64 * sizeof(u64));
+	assert(scratch->matched_goals != NULL);
 
-	trb_vector_destroy(&unmatched_boxes, NULL);
-	trb_vector_destroy(&unmatched_goals, NULL);
+	scratch->matched_boxes = malloc((ngoals + 63) / 64 * sizeof(u64));
+	assert(scratch->matched_boxes != NULL);
 
-	return matching;
+	return scratch;
 }
 
-u32 *greedy_assignment(u32 ngoals, u32 (*distances)[ngoals][ngoals])
+void greedy_scratch_destroy(GreedyScratch *scratch)
 {
-	TrbHeap pqueue;
-	trb_heap_init(&pqueue, sizeof(Edge), (TrbCmpFunc) cmp_edges);
+	free(scratch->edges);
+	free(scratch->matched_goals);
+	free(scratch->matched_boxes);
+}
 
+/*
+ * Matches the closest remaining pair of a goal and a box until every goal has
+ * a box. The edges are sorted once, O(n^2 log n), and the matched goals and
+ * boxes are bitsets, so each edge is checked in constant time.
+ */
+void greedy_assignment(GreedyScratch *scratch, u32 ngoals, u32 (*distances)[ngoals][ngoals], u32 *matching)
+{
+	Edge *edges = scratch->edges;
+	u64 *matched_goals = scratch->matched_goals;
+	u64 *matched_boxes = scratch->matched_boxes;
+
+	assert(ngoals <= scratch->ngoals);
+
+	u32 nedges = 0;
 	for (u32 goal = 0; goal < ngoals; ++goal) {
 		for (u32 box = 0; box < ngoals; ++box) {
-			Edge edge = {
+			edges[nedges++] = (Edge){
 				.goal = goal,
 				.box = box,
 				.distance = (*distances)[goal][box],
 			};
-
-			trb_heap_insert(&pqueue, &edge);
 		}
 	}
 
-	u32 *matching = malloc(ngoals * sizeof(u32));
-	assert(matching != NULL);
-
-	TrbVector unmatched_boxes;
-	trb_vector_init(&unmatched_boxes, TRUE, 4);
-	for (u32 box = 0; box < ngoals; ++box) {
-		trb_vector_push_back(&unmatched_boxes, trb_get_ptr(u32, box));
-	}
-
-	TrbVector unmatched_goals;
-	trb_vector_init(&unmatched_goals, TRUE, 4);
-	for (u32 goal = 0; goal < ngoals; ++goal) {
-		trb_vector_push_back(&unmatched_goals, trb_get_ptr(u32, goal));
-	}
+	/* Sorted from the longest to the shortest, so the edges are taken from the back */
+	qsort(edges, nedges, sizeof(Edge), (TrbCmpFunc) cmp_edges);
 
-	while (pqueue.vector.len != 0) {
-		Edge edge;
-		trb_heap_pop_back(&pqueue, &edge);
+	memset(matched_goals, 0, (ngoals + 63) / 64 * sizeof(u64));
+	memset(matched_boxes, 0, (ngoals + 63) / 64 * sizeof(u64));
 
-		usize umb_index = 0;
-		usize umg_index = 0;
+	u32 matched = 0;
+	while (matched < ngoals) {
+		Edge edge = edges[--nedges];
 
-		bool umb_contains = trb_vector_search(&unmatched_boxes, &edge.box, (TrbCmpFunc) trb_u32cmp, &umb_index);
-		bool umg_contains = trb_vector_search(&unmatched_goals, &edge.goal, (TrbCmpFunc) trb_u32cmp, &umg_index);
+		u64 goal_bit = (u64) 1 << (edge.goal % 64);
+		u64 box_bit = (u64) 1 << (edge.box % 64);
 
-		if (umb_contains && umg_contains) {
-			matching[edge.goal] = edge.box;
-			trb_vector_remove(&unmatched_boxes, umb_index, NULL);
-			trb_vector_remove(&unmatched_goals, umg_index, NULL);
-		}
-	}
-
-	for (u32 i = 0; i < unmatched_goals.len; ++i) {
-		u32 goal = trb_vector_get(&unmatched_goals, u32, i);
-		u32 closest_j = 0;
-		u32 closest_box = trb_vector_get(&unmatched_boxes, u32, 0);
-		u32 closest_dist = (*distances)[goal][closest_box];
-
-		for (u32 j = 1; j < unmatched_boxes.len; ++j) {
-			u32 box = trb_vector_get(&unmatched_boxes, u32, j);
-			u32 dist = (*distances)[goal][box];
-
-			if (dist > closest_dist) {
-				closest_j = j;
-				closest_box = box;
-				closest_dist = dist;
-			}
-		}
+		if ((matched_goals[edge.goal / 64] & goal_bit) || (matched_boxes[edge.box / 64] & box_bit))
+			continue;
 
-		trb_vector_remove(&unmatched_boxes, closest_j, NULL);
-		matching[goal] = closest_box;
+		matched_goals[edge.goal / 64] |= goal_bit;
+		matched_boxes[edge.box / 64] |= box_bit;
+		matching[edge.goal] = edge.box;
+		matched++;
 	}
-
-	trb_vector_destroy(&unmatched_boxes, NULL);
-	trb_vector_destroy(&unmatched_goals, NULL);
-	trb_heap_destroy(&pqueue, NULL);
-
-	return matching;
 }
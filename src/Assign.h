@@ -3,8 +3,65 @@
 
 #include "Definitions.h"
 
-u32 *hungarian_assignment(u32 ngoals, u32 (*distances)[ngoals][ngoals]);
-u32 *greedy_assignment(u32 ngoals, u32 (*distances)[ngoals][ngoals]);
-u32 *closest_assignment(u32 ngoals, u32 (*distances)[ngoals][ngoals]);
+/*
+ * Buffers of the shortest augmenting path search, allocated once for the
+ * largest number of goals and reused by every call.
+ */
+typedef struct {
+	u32 ngoals;
+	u32 *owner;
+	u32 *prev;
+	i64 *dist;
+	u8 *done;
+} HungarianScratch;
+
+HungarianScratch *hungarian_scratch_init(HungarianScratch *scratch, u32 ngoals);
+void hungarian_scratch_destroy(HungarianScratch *scratch);
+
+u32 hungarian_assignment(
+	HungarianScratch *scratch,
+	u32 ngoals,
+	u32 (*distances)[ngoals][ngoals],
+	i32 *goal_pot,
+	i32 *box_pot,
+	u32 *matching
+);
+
+u32 hungarian_update(
+	HungarianScratch *scratch,
+	u32 ngoals,
+	u32 (*distances)[ngoals][ngoals],
+	u32 box,
+	i32 *goal_pot,
+	i32 *box_pot,
+	u32 *matching
+);
+
+/* The boxes not matched yet, in the order they are looked at */
+typedef struct {
+	u32 ngoals;
+	u32 *unmatched;
+} ClosestScratch;
+
+ClosestScratch *closest_scratch_init(ClosestScratch *scratch, u32 ngoals);
+void closest_scratch_destroy(ClosestScratch *scratch);
+
+void closest_assignment(ClosestScratch *scratch, u32 ngoals, u32 (*distances)[ngoals][ngoals], u32 *matching);
+
+/*
+ * Buffers of the greedy matching: every goal/box edge and the bitsets of the
+ * goals and boxes matched so far.
+ */
+typedef struct {
+	u32 ngoals;
+	Edge *edges;
+	u64 *matched_goals;
+	u64 *matched_boxes;
+} GreedyScratch;
+
+GreedyScratch *greedy_scratch_init(GreedyScratch *scratch, u32 ngoals);
+void greedy_scratch_destroy(GreedyScratch *scratch);
+
+void greedy_assignment(GreedyScratch *scratch, u32 ngoals, u32 (*distances)[ngoals][ngoals], u32 *matching);
 
 #endif /* end of include guard: ASSIGN_H_TORHCHXI */
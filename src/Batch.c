@@ -0,0 +1,298 @@
+#include "Batch.h"
+
+#include "Definitions.h"
+#include "Game.h"
+#include "Level.h"
+#include "Stats.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * The levels are handed out one at a time from the file being read, and the
+ * next file is only opened once it runs out.
+ */
+typedef struct {
+	const BatchOptions *options;
+	TrbVector files;
+	usize source;
+	Pack pack;
+	bool opened;
+	_Atomic u32 solved;
+	pthread_mutex_t lock;
+} BatchRun;
+
+/*
+ * A level taken from the batch. Levels of packs are named after the pack and
+ * their number in it.
+ */
+typedef struct {
+	char *name;
+	char *title;
+	const char *file;
+	u32 index;
+	bool single;
+} BatchLevel;
+
+static i32 cmp_names(const char **a, const char **b)
+{
+	return strcmp(*a, *b);
+}
+
+static bool is_level(const char *name)
+{
+	usize len = strlen(name);
+
+	if (name[0] == '.')
+		return FALSE;
+
+	return len < 4 || strcmp(name + len - 4, ".dlk") != 0;
+}
+
+/*
+ * Adds the file, or every level in the directory in the order of their names.
+ * Levels in a directory are named by joining it and the file name with a
+ * single slash, however the directory was given.
+ */
+void batch_files(TrbVector *files, const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		char *file = strdup(path);
+		assert(file != NULL);
+
+		trb_vector_push_back(files, &file);
+		return;
+	}
+
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+		return;
+
+	usize len = strlen(path);
+	while (len > 1 && path[len - 1] == '/')
+		len--;
+
+	usize first = files->len;
+	struct dirent *entry;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (!is_level(entry->d_name))
+			continue;
+
+		char *file = malloc(len + strlen(entry->d_name) + 2);
+		assert(file != NULL);
+
+		sprintf(file, "%.*s%s%s", (int) len, path, path[len - 1] == '/' ? "" : "/", entry->d_name);
+
+		if (stat(file, &st) != 0 || !S_ISREG(st.st_mode)) {
+			free(file);
+			continue;
+		}
+
+		trb_vector_push_back(files, &file);
+	}
+
+	closedir(dir);
+
+	qsort(trb_vector_ptr(files, char *, first), files->len - first, sizeof(char *), (TrbCmpFunc) cmp_names);
+}
+
+static void batch_print(BatchRun *batch, BatchLevel *level, const char *status, usize len, double seconds, const Stats *stats)
+{
+	pthread_mutex_lock(&batch->lock);
+
+	if (batch->options->format == TEXT_FORMAT)
+		printf("%s\t%s\t%zu\t%.3f\t%s\n", level->name, status, len, seconds, level->title != NULL ? level->title : "");
+	else
+		stats_print(stdout, batch->options->format, level->name, level->title, status, len, stats);
+
+	fflush(stdout);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+/* Takes the next level, parsing it into the game unless it is invalid */
+static int batch_next(BatchRun *batch, Game *game, BatchLevel *level)
+{
+	int result = PACK_END;
+
+	pthread_mutex_lock(&batch->lock);
+
+	while (batch->source < batch->files.len) {
+		const char *file = trb_vector_get(&batch->files, char *, batch->source);
+
+		if (!batch->opened && !pack_open(&batch->pack, file)) {
+			batch->source++;
+			level->file = file;
+			level->index = 1;
+			level->single = TRUE;
+			level->title = NULL;
+			result = PACK_INVALID;
+			break;
+		}
+
+		batch->opened = TRUE;
+
+		u64 start = game_clock();
+		result = pack_next(&batch->pack, game);
+
+		if (result == PACK_LEVEL)
+			game->stats.parse_time = (game_clock() - start) / 1e9;
+
+		if (result != PACK_END) {
+			level->file = file;
+			level->index = batch->pack.count;
+			level->single = batch->pack.sized;
+			level->title = batch->pack.title != NULL ? strdup(batch->pack.title) : NULL;
+			break;
+		}
+
+		pack_close(&batch->pack);
+		batch->opened = FALSE;
+		batch->source++;
+	}
+
+	pthread_mutex_unlock(&batch->lock);
+
+	if (result == PACK_END)
+		return result;
+
+	if (level->single) {
+		level->name = strdup(level->file);
+		assert(level->name != NULL);
+	} else {
+		level->name = malloc(strlen(level->file) + sizeof ":4294967295");
+		assert(level->name != NULL);
+		sprintf(level->name, "%s:%u", level->file, level->index);
+	}
+
+	return result;
+}
+
+/* Solves one level and prints its line: the name, the outcome, the length, the seconds taken and the title */
+static void batch_level(BatchRun *batch, Game *game, BatchLevel *level)
+{
+	const BatchOptions *options = batch->options;
+	u64 start = game_clock();
+
+	game->search = options->search;
+	game->memory = options->memory;
+	game->memory_limit = options->memory_limit;
+
+	if (options->time_limit > 0)
+		game->deadline = start + (u64) (options->time_limit * 1e9);
+
+	Stats *stats = &game->stats;
+	u64 mark = start;
+
+	/* A cache for every level of a pack would litter the disk */
+	if (level->single)
+		level_calc_patterns(game, level->file, 1);
+	else
+		game_calc_patterns(game, NULL);
+
+	stats->patterns_time = (game_clock() - mark) / 1e9;
+
+	/* Once the tables have used up the time there is no search, and the level is out of time */
+	if (options->distance != -1 && !game_out_of_time(game)) {
+		mark = game_clock();
+		game_calc_distances(game, options->distance);
+		stats->distances_time = (game_clock() - mark) / 1e9;
+
+		mark = game_clock();
+		game_do_assignment(game, options->assign);
+		stats->assignment_time = (game_clock() - mark) / 1e9;
+	}
+
+	mark = game_clock();
+
+	TrbString solution;
+	bool solved = !game_out_of_time(game) && options->solver(game, &solution);
+	u64 end = game_clock();
+
+	stats->search_time = (end - mark) / 1e9;
+
+	usize len = 0;
+
+	if (solved) {
+		len = solution.len;
+		trb_string_destroy(&solution);
+		atomic_fetch_add(&batch->solved, 1);
+	}
+
+	batch_print(batch, level, game_outcome(game, solved), len, (end - start) / 1e9, stats);
+}
+
+static void *batch_worker(void *data)
+{
+	BatchRun *batch = data;
+
+	Game game;
+	BatchLevel level;
+	int result;
+
+	while ((result = batch_next(batch, &game, &level)) != PACK_END) {
+		if (result == PACK_LEVEL) {
+			batch_level(batch, &game, &level);
+			game_destroy(&game);
+		} else {
+			Stats none;
+			stats_init(&none);
+			batch_print(batch, &level, "error", 0, 0, &none);
+		}
+
+		free(level.name);
+		free(level.title);
+	}
+
+	return NULL;
+}
+
+/*
+ * Solves every level found in the given files and directories on a pool of
+ * threads, each level on a single thread. Packs are read as the levels are
+ * needed. A line is printed as soon as a
+ * level is done, so they come out in the order the levels finish. Returns the
+ * number of levels solved.
+ */
+u32 batch_solve(char **paths, u32 npaths, const BatchOptions *options)
+{
+	BatchRun batch;
+	batch.options = options;
+	batch.source = 0;
+	batch.opened = FALSE;
+	atomic_init(&batch.solved, 0);
+	pthread_mutex_init(&batch.lock, NULL);
+	trb_vector_init(&batch.files, FALSE, sizeof(char *));
+
+	for (u32 i = 0; i < npaths; ++i)
+		batch_files(&batch.files, paths[i]);
+
+	u32 nworkers = options->workers;
+	if (nworkers == 0)
+		nworkers = 1;
+
+	pthread_t workers[nworkers];
+	stats_header(stdout, options->format);
+
+	for (u32 i = 0; i < nworkers; ++i)
+		pthread_create(&workers[i], NULL, batch_worker, &batch);
+
+	for (u32 i = 0; i < nworkers; ++i)
+		pthread_join(workers[i], NULL);
+
+	for (usize i = 0; i < batch.files.len; ++i)
+		free(trb_vector_get(&batch.files, char *, i));
+
+	trb_vector_destroy(&batch.files, NULL);
+	pthread_mutex_destroy(&batch.lock);
+
+	return atomic_load(&batch.solved);
+}
@@ -0,0 +1,27 @@
+#ifndef BATCH_H_F7LKX3RE
+#define BATCH_H_F7LKX3RE
+
+#include "Definitions.h"
+#include "Game.h"
+
+/*
+ * How every level of a batch is solved. Solvers that don't estimate the
+ * remaining pushes have no distance metric. A limit of zero means none.
+ * The format is one of the formats of the statistics.
+ */
+typedef struct {
+	bool (*solver)(Game *game, TrbString *ret);
+	int distance;
+	int assign;
+	int search;
+	usize memory;
+	u32 workers;
+	double time_limit;
+	usize memory_limit;
+	int format;
+} BatchOptions;
+
+void batch_files(TrbVector *files, const char *path);
+u32 batch_solve(char **paths, u32 npaths, const BatchOptions *options);
+
+#endif /* end of include guard: BATCH_H_F7LKX3RE */
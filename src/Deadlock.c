@@ -0,0 +1,684 @@
+#include "Deadlock.h"
+
+#include "Definitions.h"
+#include "Game.h"
+
+#include <assert.h>
+#include <memory.h>
+#include <stdlib.h>
+
+/*
+ * Marks the squares from which a box can still be pushed to some goal. These
+ * are exactly the squares a box can be pulled to from a goal, so the goals
+ * are pulled from all at once in a single breadth-first pass. A box pushed
+ * onto an unmarked square can never be solved.
+ */
+void live_squares(
+	point *goals,
+	u32 w, u32 h,
+	u8 (*board)[h][w],
+	u32 ngoals,
+	u8 (*ret)[h][w]
+)
+{
+	memset(ret, 0, sizeof *ret);
+
+	point *queue = malloc(w * h * sizeof(point));
+	assert(queue != NULL);
+
+	u32 head = 0;
+	u32 tail = 0;
+
+	for (u32 goal = 0; goal < ngoals; ++goal) {
+		point gpos = goals[goal];
+
+		if ((*ret)[gpos.y][gpos.x])
+			continue;
+
+		(*ret)[gpos.y][gpos.x] = 1;
+		queue[tail++] = gpos;
+	}
+
+	while (head != tail) {
+		point pos = queue[head++];
+
+		u32 x = pos.x;
+		u32 y = pos.y;
+
+		struct {
+			u32 px, py;
+			u32 bx, by;
+			bool skip;
+		} dirs[4] = {
+			{x - 2,  y,     x - 1, y,     x <= 1    },
+			{ x,     y - 2, x,     y - 1, y <= 1    },
+			{ x + 2, y,     x + 1, y,     x + 2 >= w},
+			{ x,     y + 2, x,     y + 1, y + 2 >= h},
+		};
+
+		for (u32 i = 0; i < 4; ++i) {
+			if (dirs[i].skip)
+				continue;
+
+			u32 px = dirs[i].px;
+			u32 py = dirs[i].py;
+			u32 bx = dirs[i].bx;
+			u32 by = dirs[i].by;
+
+			if ((*ret)[by][bx])
+				continue;
+
+			if ((*board)[by][bx] == WALL || (*board)[py][px] == WALL)
+				continue;
+
+			(*ret)[by][bx] = 1;
+			queue[tail++] = (point){ bx, by };
+		}
+	}
+
+	free(queue);
+}
+
+/*
+ * Occupancy value of a box that is being checked for freezing. While the
+ * check runs, the box counts as a wall for its neighbours.
+ */
+#define FROZEN_BOX (U32_MAX - 1)
+
+typedef struct {
+	u32 w, h;
+	u8 *board;
+	u8 *marks;
+	u32 *occupancy;
+} Freeze;
+
+static bool freeze_wall(Freeze *f, u32 x, u32 y)
+{
+	if (x >= f->w || y >= f->h)
+		return TRUE;
+
+	u8 square = f->board[y * f->w + x];
+
+	return square == WALL || square == 0 || f->occupancy[y * f->w + x] == FROZEN_BOX;
+}
+
+static bool box_frozen(Freeze *f, u32 x, u32 y, bool *off_goal);
+
+/*
+ * Checks whether the box at (x, y) can never move along the given axis.
+ */
+static bool axis_blocked(Freeze *f, u32 x, u32 y, i32 dx, i32 dy, bool *off_goal)
+{
+	u32 ax = x - dx, ay = y - dy;
+	u32 bx = x + dx, by = y + dy;
+
+	if (freeze_wall(f, ax, ay) || freeze_wall(f, bx, by))
+		return TRUE;
+
+	if (f->marks[ay * f->w + ax] == 0 && f->marks[by * f->w + bx] == 0)
+		return TRUE;
+
+	if (f->occupancy[ay * f->w + ax] != -1 && box_frozen(f, ax, ay, off_goal))
+		return TRUE;
+
+	if (f->occupancy[by * f->w + bx] != -1 && box_frozen(f, bx, by, off_goal))
+		return TRUE;
+
+	return FALSE;
+}
+
+/*
+ * A box is frozen when it is blocked along both axes. Boxes found frozen on
+ * the way only count towards off_goal if the whole check succeeds.
+ */
+static bool box_frozen(Freeze *f, u32 x, u32 y, bool *off_goal)
+{
+	u32 i = y * f->w + x;
+	u32 box = f->occupancy[i];
+
+	bool off = f->board[i] != GOAL;
+
+	f->occupancy[i] = FROZEN_BOX;
+
+	bool frozen = axis_blocked(f, x, y, 1, 0, &off) && axis_blocked(f, x, y, 0, 1, &off);
+
+	f->occupancy[i] = box;
+
+	if (frozen)
+		*off_goal |= off;
+
+	return frozen;
+}
+
+/*
+ * Checks whether the box that was just pushed to the given square got frozen
+ * together with at least one box that is not on a goal.
+ */
+bool freeze_deadlock(
+	u32 w, u32 h,
+	u8 (*board)[h][w],
+	u8 (*marks)[h][w],
+	u32 (*occupancy)[h][w],
+	point box
+)
+{
+	Freeze f = { w, h, (u8 *) board, (u8 *) marks, (u32 *) occupancy };
+	bool off_goal = FALSE;
+
+	return box_frozen(&f, box.x, box.y, &off_goal) && off_goal;
+}
+
+/*
+ * Looks at the areas next to the box that was just pushed which the player
+ * cannot reach. If such an area is fenced off by walls and frozen boxes only,
+ * no box can ever enter it again, so an empty goal inside is a deadlock.
+ * The seen grid and the queue of w * h squares are scratch space.
+ */
+bool corral_deadlock(
+	u32 w, u32 h,
+	u8 (*board)[h][w],
+	u8 (*marks)[h][w],
+	u32 (*occupancy)[h][w],
+	u8 (*seen)[h][w],
+	point *queue,
+	point player,
+	point box
+)
+{
+	Freeze f = { w, h, (u8 *) board, (u8 *) marks, (u32 *) occupancy };
+
+	memset(seen, 0, sizeof *seen);
+
+	static const i32 dx[4] = { -1, 0, 1, 0 };
+	static const i32 dy[4] = { 0, -1, 0, 1 };
+
+	(*seen)[player.y][player.x] = 1;
+
+	for (u32 start = 0; start < 4; ++start) {
+		u32 sx = box.x + dx[start];
+		u32 sy = box.y + dy[start];
+
+		if (freeze_wall(&f, sx, sy) || (*seen)[sy][sx] || (*occupancy)[sy][sx] != -1)
+			continue;
+
+		u32 head = 0;
+		u32 tail = 0;
+
+		bool sealed = TRUE;
+		bool empty_goal = FALSE;
+
+		(*seen)[sy][sx] = 1;
+		queue[tail++] = (point){ sx, sy };
+
+		while (head != tail && sealed) {
+			point pos = queue[head++];
+
+			if ((*board)[pos.y][pos.x] == GOAL)
+				empty_goal = TRUE;
+
+			for (u32 dir = 0; dir < 4 && sealed; ++dir) {
+				u32 x = pos.x + dx[dir];
+				u32 y = pos.y + dy[dir];
+
+				if (freeze_wall(&f, x, y))
+					continue;
+
+				if (x == player.x && y == player.y) {
+					sealed = FALSE;
+				} else if ((*occupancy)[y][x] != -1) {
+					bool off_goal = FALSE;
+
+					if (!box_frozen(&f, x, y, &off_goal))
+						sealed = FALSE;
+				} else if (!(*seen)[y][x]) {
+					(*seen)[y][x] = 1;
+					queue[tail++] = (point){ x, y };
+				}
+			}
+		}
+
+		if (sealed && empty_goal)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Patterns are sets of boxes inside a 3x3 window of the board, bit dy * 3 + dx
+ * standing for the square (ax + dx, ay + dy) of the window anchored at
+ * (ax, ay). Each anchor gets a 512-bit table of the patterns proven dead.
+ */
+#define PATTERN_SIZE 3
+#define PATTERN_BOXES 4
+#define PATTERN_STATES 1024
+
+/* The closed states are hashed into twice as many slots, which is a power of two */
+#define PATTERN_SLOTS (2 * PATTERN_STATES)
+
+/*
+ * The player is only followed this far around the window. Everything further
+ * away counts as a single free area joining all the squares next to it, which
+ * lets the player go around more than it can, so no live pattern is lost.
+ */
+#define PATTERN_MARGIN 4
+#define PATTERN_AREA (PATTERN_SIZE + 2 * PATTERN_MARGIN)
+
+typedef struct {
+	u32 mask;
+	point player;
+} PatternState;
+
+/*
+ * A slot of the closed set holds a state as its mask and the cell of the
+ * player. Slots stamped by an earlier search count as empty, so the set is
+ * never cleared.
+ */
+typedef struct {
+	u32 key;
+	u32 stamp;
+} PatternSlot;
+
+typedef struct {
+	u32 w, h;
+	u8 *board;
+	u8 *marks;
+	u8 *boxes;
+	u8 *reach;
+	u8 *seen;
+	point *queue;
+	PatternState *open;
+	PatternSlot *closed;
+	u32 stamp;
+
+	/* The area around the current window and the squares of it next to the rest */
+	u32 x0, y0, x1, y1;
+	u8 *gate;
+	point gates[4 * PATTERN_AREA];
+	u32 ngates;
+} Pattern;
+
+static bool pattern_free(Pattern *p, u32 x, u32 y)
+{
+	if (x >= p->w || y >= p->h)
+		return FALSE;
+
+	u8 square = p->board[y * p->w + x];
+
+	return square != WALL && square != 0 && !p->boxes[y * p->w + x];
+}
+
+static bool pattern_inside(Pattern *p, u32 x, u32 y)
+{
+	return x >= p->x0 && x < p->x1 && y >= p->y0 && y < p->y1;
+}
+
+/* Settles the area the player is followed in around the window anchored at (ax, ay) */
+static void pattern_area(Pattern *p, u32 ax, u32 ay)
+{
+	static const i32 dx[4] = { -1, 0, 1, 0 };
+	static const i32 dy[4] = { 0, -1, 0, 1 };
+
+	for (u32 i = 0; i < p->ngates; ++i)
+		p->gate[p->gates[i].y * p->w + p->gates[i].x] = 0;
+
+	p->x0 = ax > PATTERN_MARGIN ? ax - PATTERN_MARGIN : 0;
+	p->y0 = ay > PATTERN_MARGIN ? ay - PATTERN_MARGIN : 0;
+	p->x1 = ax + PATTERN_SIZE + PATTERN_MARGIN < p->w ? ax + PATTERN_SIZE + PATTERN_MARGIN : p->w;
+	p->y1 = ay + PATTERN_SIZE + PATTERN_MARGIN < p->h ? ay + PATTERN_SIZE + PATTERN_MARGIN : p->h;
+	p->ngates = 0;
+
+	for (u32 y = p->y0; y < p->y1; ++y) {
+		for (u32 x = p->x0; x < p->x1; ++x) {
+			if (!pattern_free(p, x, y))
+				continue;
+
+			for (u32 dir = 0; dir < 4; ++dir) {
+				u32 nx = x + dx[dir];
+				u32 ny = y + dy[dir];
+
+				if (!pattern_inside(p, nx, ny) && pattern_free(p, nx, ny)) {
+					p->gate[y * p->w + x] = 1;
+					p->gates[p->ngates++] = (point){ x, y };
+					break;
+				}
+			}
+		}
+	}
+}
+
+static void pattern_set(Pattern *p, u32 ax, u32 ay, u32 mask, u8 value)
+{
+	for (u32 i = 0; i < PATTERN_SIZE * PATTERN_SIZE; ++i) {
+		if (mask & (1u << i))
+			p->boxes[(ay + i / PATTERN_SIZE) * p->w + ax + i % PATTERN_SIZE] = value;
+	}
+}
+
+static bool pattern_on_goals(Pattern *p, u32 ax, u32 ay, u32 mask)
+{
+	for (u32 i = 0; i < PATTERN_SIZE * PATTERN_SIZE; ++i) {
+		if ((mask & (1u << i)) && p->board[(ay + i / PATTERN_SIZE) * p->w + ax + i % PATTERN_SIZE] != GOAL)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Flood fills the squares of the area the player reaches from the given one
+ * and returns the top-left of them. Reaching the rest of the board reaches
+ * every square next to it.
+ */
+static point pattern_reach(Pattern *p, point start)
+{
+	static const i32 dx[4] = { -1, 0, 1, 0 };
+	static const i32 dy[4] = { 0, -1, 0, 1 };
+
+	for (u32 y = p->y0; y < p->y1; ++y)
+		memset(&p->reach[y * p->w + p->x0], 0, p->x1 - p->x0);
+
+	u32 head = 0;
+	u32 tail = 0;
+	bool outside = FALSE;
+
+	point min = start;
+	p->reach[start.y * p->w + start.x] = 1;
+	p->queue[tail++] = start;
+
+	while (head != tail) {
+		point pos = p->queue[head++];
+
+		if (pos.y < min.y || (pos.y == min.y && pos.x < min.x))
+			min = pos;
+
+		if (p->gate[pos.y * p->w + pos.x] && !outside) {
+			outside = TRUE;
+
+			for (u32 i = 0; i < p->ngates; ++i) {
+				point gate = p->gates[i];
+
+				if (!p->reach[gate.y * p->w + gate.x]) {
+					p->reach[gate.y * p->w + gate.x] = 1;
+					p->queue[tail++] = gate;
+				}
+			}
+		}
+
+		for (u32 dir = 0; dir < 4; ++dir) {
+			u32 x = pos.x + dx[dir];
+			u32 y = pos.y + dy[dir];
+
+			if (!pattern_inside(p, x, y) || !pattern_free(p, x, y) || p->reach[y * p->w + x])
+				continue;
+
+			p->reach[y * p->w + x] = 1;
+			p->queue[tail++] = (point){ x, y };
+		}
+	}
+
+	return min;
+}
+
+/* Adds the state to the closed set, returning FALSE if it was already there */
+static bool pattern_close(Pattern *p, u32 mask, point player)
+{
+	u32 key = mask * p->w * p->h + player.y * p->w + player.x;
+	u32 i = (key * 0x9e3779b1u) >> 21 & (PATTERN_SLOTS - 1);
+
+	while (p->closed[i].stamp == p->stamp) {
+		if (p->closed[i].key == key)
+			return FALSE;
+
+		i = (i + 1) & (PATTERN_SLOTS - 1);
+	}
+
+	p->closed[i] = (PatternSlot){ key, p->stamp };
+
+	return TRUE;
+}
+
+/*
+ * Searches the pushes of the boxes of the pattern with no other boxes on the
+ * board, starting with the player in every area it could be in. The pattern
+ * is alive once a box leaves the window or all of them stand on goals. Running
+ * out of states also counts as alive, so only proven patterns end up dead.
+ */
+static bool pattern_alive(Pattern *p, u32 ax, u32 ay, u32 mask)
+{
+	static const i32 dx[4] = { -1, 0, 1, 0 };
+	static const i32 dy[4] = { 0, -1, 0, 1 };
+
+	u32 nopen = 0;
+	u32 nclosed = 0;
+
+	p->stamp++;
+	pattern_set(p, ax, ay, mask, 1);
+
+	for (u32 y = p->y0; y < p->y1; ++y)
+		memset(&p->seen[y * p->w + p->x0], 0, p->x1 - p->x0);
+
+	for (u32 y = p->y0; y < p->y1; ++y) {
+		for (u32 x = p->x0; x < p->x1; ++x) {
+			if (!pattern_free(p, x, y) || p->seen[y * p->w + x])
+				continue;
+
+			pattern_reach(p, (point){ x, y });
+
+			for (u32 ry = p->y0; ry < p->y1; ++ry) {
+				for (u32 rx = p->x0; rx < p->x1; ++rx)
+					p->seen[ry * p->w + rx] |= p->reach[ry * p->w + rx];
+			}
+
+			if (nopen == PATTERN_STATES) {
+				pattern_set(p, ax, ay, mask, 0);
+				return TRUE;
+			}
+
+			p->open[nopen++] = (PatternState){ mask, { x, y } };
+		}
+	}
+
+	pattern_set(p, ax, ay, mask, 0);
+
+	for (u32 head = 0; head < nopen; ++head) {
+		PatternState state = p->open[head];
+
+		pattern_set(p, ax, ay, state.mask, 1);
+		point canon = pattern_reach(p, state.player);
+
+		if (!pattern_close(p, state.mask, canon)) {
+			pattern_set(p, ax, ay, state.mask, 0);
+			continue;
+		}
+
+		nclosed++;
+
+		for (u32 i = 0; i < PATTERN_SIZE * PATTERN_SIZE; ++i) {
+			if (!(state.mask & (1u << i)))
+				continue;
+
+			u32 x = ax + i % PATTERN_SIZE;
+			u32 y = ay + i / PATTERN_SIZE;
+
+			for (u32 dir = 0; dir < 4; ++dir) {
+				u32 px = x - dx[dir];
+				u32 py = y - dy[dir];
+				u32 bx = x + dx[dir];
+				u32 by = y + dy[dir];
+
+				if (px >= p->w || py >= p->h || !p->reach[py * p->w + px])
+					continue;
+
+				if (!pattern_free(p, bx, by) || p->marks[by * p->w + bx] == 0)
+					continue;
+
+				if (bx - ax >= PATTERN_SIZE || by - ay >= PATTERN_SIZE) {
+					pattern_set(p, ax, ay, state.mask, 0);
+					return TRUE;
+				}
+
+				u32 next = (state.mask & ~(1u << i)) | (1u << ((by - ay) * PATTERN_SIZE + bx - ax));
+
+				if (pattern_on_goals(p, ax, ay, next)) {
+					pattern_set(p, ax, ay, state.mask, 0);
+					return TRUE;
+				}
+
+				if (nopen == PATTERN_STATES || nclosed == PATTERN_STATES) {
+					pattern_set(p, ax, ay, state.mask, 0);
+					return TRUE;
+				}
+
+				p->open[nopen++] = (PatternState){ next, { x, y } };
+			}
+		}
+
+		pattern_set(p, ax, ay, state.mask, 0);
+	}
+
+	return FALSE;
+}
+
+/*
+ * Proves which box patterns of up to four boxes are deadlocks in every window
+ * that touches a wall. A pattern containing a dead one is dead as well, so
+ * every table is closed over supersets, which covers patterns of more boxes.
+ * Returns FALSE if the game was cancelled first, leaving the windows not yet
+ * searched without any dead patterns.
+ */
+bool pattern_deadlocks(
+	Game *game,
+	u32 w, u32 h,
+	u8 (*board)[h][w],
+	u8 (*marks)[h][w],
+	u64 (*ret)[h][w][8]
+)
+{
+	memset(ret, 0, sizeof *ret);
+
+	Pattern p = {
+		.w = w,
+		.h = h,
+		.board = (u8 *) board,
+		.marks = (u8 *) marks,
+		.boxes = calloc(w * h, 1),
+		.reach = calloc(w * h, 1),
+		.seen = malloc(w * h),
+		.queue = malloc(w * h * sizeof(point)),
+		.open = malloc(PATTERN_STATES * sizeof(PatternState)),
+		.closed = calloc(PATTERN_SLOTS, sizeof(PatternSlot)),
+		.stamp = 0,
+		.gate = calloc(w * h, 1),
+		.ngates = 0,
+	};
+
+	assert(p.boxes != NULL);
+	assert(p.reach != NULL);
+	assert(p.seen != NULL);
+	assert(p.queue != NULL);
+	assert(p.open != NULL);
+	assert(p.closed != NULL);
+	assert(p.gate != NULL);
+
+	bool done = TRUE;
+
+	for (u32 ay = 0; ay + PATTERN_SIZE <= h && done; ++ay) {
+		for (u32 ax = 0; ax + PATTERN_SIZE <= w; ++ax) {
+			u32 live = 0;
+			bool walls = FALSE;
+
+			for (u32 i = 0; i < PATTERN_SIZE * PATTERN_SIZE; ++i) {
+				u32 x = ax + i % PATTERN_SIZE;
+				u32 y = ay + i / PATTERN_SIZE;
+
+				if ((*board)[y][x] == WALL)
+					walls = TRUE;
+				else if ((*marks)[y][x])
+					live |= 1u << i;
+			}
+
+			if (!walls || __builtin_popcount(live) < 2)
+				continue;
+
+			if (game_cancelled(game)) {
+				done = FALSE;
+				break;
+			}
+
+			pattern_area(&p, ax, ay);
+
+			u64 *dead = (*ret)[ay][ax];
+
+			for (u32 mask = 1; mask < 1u << (PATTERN_SIZE * PATTERN_SIZE); ++mask) {
+				bool is_dead = FALSE;
+
+				for (u32 i = 0; i < PATTERN_SIZE * PATTERN_SIZE && !is_dead; ++i) {
+					u32 sub = mask & ~(1u << i);
+
+					if (sub != mask && (dead[sub / 64] >> (sub % 64) & 1))
+						is_dead = TRUE;
+				}
+
+				if (
+					!is_dead &&
+					(mask & ~live) == 0 &&
+					__builtin_popcount(mask) >= 2 &&
+					__builtin_popcount(mask) <= PATTERN_BOXES &&
+					!pattern_on_goals(&p, ax, ay, mask)
+				) {
+					is_dead = !pattern_alive(&p, ax, ay, mask);
+				}
+
+				if (is_dead)
+					dead[mask / 64] |= (u64) 1 << (mask % 64);
+			}
+		}
+	}
+
+	free(p.boxes);
+	free(p.reach);
+	free(p.seen);
+	free(p.queue);
+	free(p.open);
+	free(p.closed);
+	free(p.gate);
+
+	return done;
+}
+
+/*
+ * Checks every window around the box that was just pushed against the
+ * proven patterns.
+ */
+bool pattern_deadlock(
+	u32 w, u32 h,
+	u64 (*patterns)[h][w][8],
+	u32 (*occupancy)[h][w],
+	point box
+)
+{
+	for (u32 dy = 0; dy < PATTERN_SIZE; ++dy) {
+		for (u32 dx = 0; dx < PATTERN_SIZE; ++dx) {
+			if (dx > box.x || dy > box.y)
+				continue;
+
+			u32 ax = box.x - dx;
+			u32 ay = box.y - dy;
+
+			if (ax + PATTERN_SIZE > w || ay + PATTERN_SIZE > h)
+				continue;
+
+			u32 mask = 0;
+			for (u32 i = 0; i < PATTERN_SIZE * PATTERN_SIZE; ++i) {
+				if ((*occupancy)[ay + i / PATTERN_SIZE][ax + i % PATTERN_SIZE] != -1)
+					mask |= 1u << i;
+			}
+
+			if ((*patterns)[ay][ax][mask / 64] >> (mask % 64) & 1)
+				return TRUE;
+		}
+	}
+
+	return FALSE;
+}
@@ -0,0 +1,49 @@
+#ifndef DEADLOCK_H_R7DXW2LC
+#define DEADLOCK_H_R7DXW2LC
+
+#include "Definitions.h"
+#include "Game.h"
+
+void live_squares(
+	point *goals,
+	u32 w, u32 h,
+	u8 (*board)[h][w],
+	u32 ngoals,
+	u8 (*ret)[h][w]
+);
+
+bool freeze_deadlock(
+	u32 w, u32 h,
+	u8 (*board)[h][w],
+	u8 (*marks)[h][w],
+	u32 (*occupancy)[h][w],
+	point box
+);
+
+bool corral_deadlock(
+	u32 w, u32 h,
+	u8 (*board)[h][w],
+	u8 (*marks)[h][w],
+	u32 (*occupancy)[h][w],
+	u8 (*seen)[h][w],
+	point *queue,
+	point player,
+	point box
+);
+
+bool pattern_deadlocks(
+	Game *game,
+	u32 w, u32 h,
+	u8 (*board)[h][w],
+	u8 (*marks)[h][w],
+	u64 (*ret)[h][w][8]
+);
+
+bool pattern_deadlock(
+	u32 w, u32 h,
+	u64 (*patterns)[h][w][8],
+	u32 (*occupancy)[h][w],
+	point box
+);
+
+#endif /* end of include guard: DEADLOCK_H_R7DXW2LC */
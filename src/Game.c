@@ -1,54 +1,63 @@
 #include "Game.h"
 
 #include "Assign.h"
+#include "Deadlock.h"
 #include "Definitions.h"
 #include "Distance.h"
+#include "Pool.h"
+#include "Search.h"
 
 #include <assert.h>
 #include <memory.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
-static State *state_init(State *state, State *init, usize ngoals)
+static State *state_init(State *state, State *init, usize ngoals, Pool *pool)
 {
-	state->positions = calloc(ngoals + 1, sizeof(point));
+	if (pool != NULL)
+		state->positions = pool_alloc(pool);
+	else
+		state->positions = calloc(ngoals + 1, sizeof(point));
+
 	assert(state->positions != NULL);
 
+	state->parent = U32_MAX;
+	state->move = 0;
+	state->closed = FALSE;
 	state->distance = 0;
 	state->total_distance = 0;
+	state->hash = 0;
+	state->on_goals = 0;
 
 	if (init != NULL) {
 		memcpy(state->positions, init->positions, (ngoals + 1) * sizeof(point));
+		state->hash = init->hash;
+		state->on_goals = init->on_goals;
 		state->distance = init->distance;
 		state->total_distance = init->total_distance;
 	}
 
-	trb_string_init0(&state->solution);
-
-	if (init != NULL && init->solution.data != NULL)
-		trb_string_assign(&state->solution, init->solution.data);
-
 	return state;
 }
 
 void state_destroy(State *state)
 {
 	free(state->positions);
-	trb_string_destroy(&state->solution);
 }
 
-static i32 pos_cmp(const point *a, const point *b, u32 *data)
+i32 key_cmp(const u8 *a, const u8 *b, u32 *keysize)
 {
-	u32 ngoals = *data;
+	return memcmp(a, b, *keysize);
+}
 
-	for (u32 i = 0; i <= ngoals; ++i) {
-		if (a[i].x > b[i].x || a[i].y > b[i].y)
-			return 1;
-		if (a[i].x < b[i].x || a[i].y < b[i].y)
-			return -1;
-	}
+/* Keys start with the Zobrist hash of the state, so there is nothing to compute */
+u32 key_hash(const void *key, usize keysize, u32 seed)
+{
+	u64 hash;
+	memcpy(&hash, key, sizeof hash);
 
-	return 0;
+	return hash ^ (hash >> 32);
 }
 
 static i32 state_pcmp(const State *a, const State *b)
@@ -60,9 +69,22 @@ static i32 state_pcmp(const State *a, const State *b)
 	return 0;
 }
 
-static i32 state_cmp(const State *a, const State *b, u32 *data)
+static i32 node_pcmp(const u32 *a, const u32 *b, TrbVector *nodes)
+{
+	return state_pcmp(trb_vector_ptr(nodes, State, *a), trb_vector_ptr(nodes, State, *b));
+}
+
+i32 open_pcmp(const OpenEntry *a, const OpenEntry *b)
 {
-	return pos_cmp(a->positions, b->positions, data);
+	if (a->total_distance > b->total_distance)
+		return -1;
+	if (a->total_distance < b->total_distance)
+		return 1;
+	if (a->distance < b->distance)
+		return -1;
+	if (a->distance > b->distance)
+		return 1;
+	return 0;
 }
 
 Game *game_init(Game *game)
@@ -73,8 +95,64 @@ Game *game_init(Game *game)
 	game->board = NULL;
 	game->goals = NULL;
 	game->marks = NULL;
+	game->cells = NULL;
+	game->ncells = 0;
+	game->cellbytes = 0;
+	game->keysize = 0;
+	game->zobrist = NULL;
+	game->patterns = NULL;
 	game->distances = NULL;
-	game->assignment = NULL;
+	game->assign = HUNGARIAN_ASSIGN;
+	game->search = MOVE_SEARCH;
+	game->memory = 64 << 20;
+	game->threads = 1;
+	game->cancel = NULL;
+	game->deadline = 0;
+	game->memory_limit = 0;
+	atomic_init(&game->allocated, 0);
+	atomic_init(&game->exhausted, FALSE);
+	game->parent = NULL;
+	stats_init(&game->stats);
+
+	return game;
+}
+
+static void *copy_array(const void *src, usize size)
+{
+	if (src == NULL)
+		return NULL;
+
+	void *ret = malloc(size);
+	assert(ret != NULL);
+
+	return memcpy(ret, src, size);
+}
+
+/*
+ * Makes an independent copy of a parsed level, so that it can be solved on
+ * another thread with its own distances and settings. The copy still stops
+ * when the source is cancelled and its states count against the memory limit
+ * of the source, which has to outlive it.
+ */
+Game *game_copy(Game *game, Game *src)
+{
+	u32 w = src->width;
+	u32 h = src->height;
+
+	*game = *src;
+
+	game->board = copy_array(src->board, w * h);
+	game->marks = copy_array(src->marks, w * h);
+	game->goals = copy_array(src->goals, src->ngoals * sizeof(point));
+	game->cells = copy_array(src->cells, w * h * sizeof(u32));
+	game->zobrist = copy_array(src->zobrist, 2 * src->ncells * sizeof(u64));
+	game->patterns = copy_array(src->patterns, w * h * 8 * sizeof(u64));
+	game->distances = copy_array(src->distances, src->ngoals * w * h * sizeof(u32));
+	game->state.positions = copy_array(src->state.positions, (src->ngoals + 1) * sizeof(point));
+	atomic_init(&game->allocated, 0);
+	atomic_init(&game->exhausted, FALSE);
+	game->parent = src;
+	stats_init(&game->stats);
 
 	return game;
 }
@@ -82,12 +160,12 @@ Game *game_init(Game *game)
 void game_reset(Game *game)
 {
 	free(game->marks);
+	free(game->cells);
+	free(game->zobrist);
+	free(game->patterns);
 
 	if (game->distances != NULL)
 		free(game->distances);
-
-	if (game->assignment != NULL)
-		free(game->assignment);
 }
 
 void game_destroy(Game *game)
@@ -95,63 +173,158 @@ void game_destroy(Game *game)
 	free(game->board);
 	free(game->goals);
 	free(game->marks);
+	free(game->cells);
+	free(game->zobrist);
+	free(game->patterns);
 
 	if (game->distances != NULL)
 		free(game->distances);
 
-	if (game->assignment != NULL)
-		free(game->assignment);
-
 	state_destroy(&game->state);
 }
 
-static void mark(Game *game, u32 x, u32 y)
+/* The game every copy was made from, which keeps the memory count for all of them */
+static Game *game_root(Game *game)
 {
-	u32 w = game->width;
-	u32 h = game->height;
+	while (game->parent != NULL)
+		game = game->parent;
 
-	u8(*marks)[h][w] = (u8(*)[h][w]) game->marks;
-	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
+	return game;
+}
+
+Search *search_init(Search *search, Game *game)
+{
+	search->game = game;
+	search->charged = 0;
+	stats_init(&search->stats);
+
+	/* The Hungarian heuristic keeps its potentials and matching after the positions */
+	usize size = (game->ngoals + 1) * sizeof(point);
+	if (game->distances != NULL && game->assign == HUNGARIAN_ASSIGN)
+		size += 3 * game->ngoals * sizeof(u32);
+
+	pool_init(&search->pool, size);
+	search->pool.usage = &game_root(game)->allocated;
+	trb_vector_init(&search->nodes, FALSE, sizeof(State));
+
+	search->reach = malloc(game->width * game->height);
+	assert(search->reach != NULL);
+
+	search->occupancy = malloc(game->width * game->height * sizeof(u32));
+	assert(search->occupancy != NULL);
+
+	memset(search->occupancy, 0xff, game->width * game->height * sizeof(u32));
+
+	search->seen = malloc(game->width * game->height);
+	assert(search->seen != NULL);
+
+	search->queue = malloc(game->width * game->height * sizeof(point));
+	assert(search->queue != NULL);
+
+	search->key = malloc(game->keysize);
+	assert(search->key != NULL);
+
+	search->costs = malloc(game->ngoals * game->ngoals * sizeof(u32));
+	assert(search->costs != NULL);
+
+	hungarian_scratch_init(&search->hungarian, game->ngoals);
+	greedy_scratch_init(&search->greedy, game->ngoals);
+	closest_scratch_init(&search->closest, game->ngoals);
+
+	State init_state;
+	state_init(&init_state, &game->state, game->ngoals, &search->pool);
+	trb_vector_push_back(&search->nodes, &init_state);
+
+	return search;
+}
+
+/* The counts of the search are added to the game, which is where they are reported from */
+void search_destroy(Search *search)
+{
+	stats_peak(&search->stats.peak_visited, search->nodes.len);
+	stats_add(&search->game->stats, &search->stats);
+
+	atomic_fetch_sub_explicit(&game_root(search->game)->allocated, search->charged, memory_order_relaxed);
+
+	trb_vector_destroy(&search->nodes, NULL);
+	pool_destroy(&search->pool);
+	free(search->reach);
+	free(search->occupancy);
+	free(search->seen);
+	free(search->queue);
+	free(search->key);
+	free(search->costs);
+	hungarian_scratch_destroy(&search->hungarian);
+	greedy_scratch_destroy(&search->greedy);
+	closest_scratch_destroy(&search->closest);
+}
+
+/*
+ * Charges the tables of the solver against the memory limit, besides the
+ * positions, which come from the pool: the node store, visited tables holding
+ * the given number of keys, and the given bytes of anything else such as the
+ * open list. Hash tables are taken to be half empty. The tables keep their
+ * size once grown, so only the growth past the most charged so far counts.
+ */
+void search_charge(Search *search, usize visited, usize extra)
+{
+	Game *game = search->game;
+	usize bytes = search->nodes.len * sizeof(State) + visited * 2 * (game->keysize + sizeof(u32)) + extra;
 
-	if ((*marks)[y][x])
+	if (bytes <= search->charged)
 		return;
 
-	(*marks)[y][x] = 1;
+	atomic_fetch_add_explicit(&game_root(game)->allocated, bytes - search->charged, memory_order_relaxed);
+	search->charged = bytes;
+}
+
+/*
+ * Fills the occupancy grid with the boxes of the state. Every placed state
+ * has to be cleared again before another one is placed.
+ */
+static void search_place(Search *search, State *state)
+{
+	u32 w = search->game->width;
 
-	if (x > 1 && (*board)[y][x - 1] != WALL && (*board)[y][x - 2] != WALL)
-		mark(game, x - 1, y);
-	if (x < w - 2 && (*board)[y][x + 1] != WALL && (*board)[y][x + 2] != WALL)
-		mark(game, x + 1, y);
-	if (y > 1 && (*board)[y - 1][x] != WALL && (*board)[y - 2][x] != WALL)
-		mark(game, x, y - 1);
-	if (y < h - 2 && (*board)[y + 1][x] != WALL && (*board)[y + 2][x] != WALL)
-		mark(game, x, y + 1);
+	for (u32 i = 1; i <= search->game->ngoals; ++i) {
+		point box = state->positions[i];
+		search->occupancy[box.y * w + box.x] = i;
+	}
 }
 
-static u32 game_get_box(Game *game, State *state, u32 x, u32 y)
+static void search_clear(Search *search, State *state)
 {
-	for (u32 i = 1; i <= game->ngoals; ++i) {
-		point pos = state->positions[i];
-		if (pos.x == x && pos.y == y)
-			return i;
+	u32 w = search->game->width;
+
+	for (u32 i = 1; i <= search->game->ngoals; ++i) {
+		point box = state->positions[i];
+		search->occupancy[box.y * w + box.x] = -1;
 	}
+}
 
-	return -1;
+static u32 game_get_box(Search *search, u32 x, u32 y)
+{
+	return search->occupancy[y * search->game->width + x];
 }
 
-static bool is_solved(Game *game, State *state)
+static u64 zobrist_player(Game *game, point pos)
 {
-	for (u32 i = 0; i < game->ngoals; ++i) {
-		point goal = game->goals[i];
-		if (game_get_box(game, state, goal.x, goal.y) == -1)
-			return FALSE;
-	}
+	return game->zobrist[game->cells[pos.y * game->width + pos.x]];
+}
 
-	return TRUE;
+static u64 zobrist_box(Game *game, point pos)
+{
+	return game->zobrist[game->ncells + game->cells[pos.y * game->width + pos.x]];
 }
 
-static bool game_move(Game *game, State *state, u32 x, u32 y, State *ret)
+bool is_solved(Game *game, State *state)
 {
+	return state->on_goals == game->ngoals;
+}
+
+static bool game_move(Search *search, State *state, u32 x, u32 y, State *ret)
+{
+	Game *game = search->game;
 	u32 w = game->width;
 	u32 h = game->height;
 
@@ -160,14 +333,16 @@ static bool game_move(Game *game, State *state, u32 x, u32 y, State *ret)
 	if ((*board)[y][x] == '#' || (*board)[y][x] == 0)
 		return FALSE;
 
-	state_init(ret, state, game->ngoals);
+	state_init(ret, state, game->ngoals, &search->pool);
 	ret->positions[0] = (point){ x, y };
+	ret->hash ^= zobrist_player(game, state->positions[0]) ^ zobrist_player(game, ret->positions[0]);
 
 	return TRUE;
 }
 
-static bool game_push(Game *game, State *state, u32 px, u32 py, u32 bx, u32 by, u32 bi, State *ret)
+static bool game_push(Search *search, State *state, u32 px, u32 py, u32 bx, u32 by, u32 bi, State *ret)
 {
+	Game *game = search->game;
 	u32 w = game->width;
 	u32 h = game->height;
 
@@ -178,427 +353,1507 @@ static bool game_push(Game *game, State *state, u32 px, u32 py, u32 bx, u32 by,
 		(*board)[by][bx] == '#' ||
 		(*board)[by][bx] == 0 ||
 		(*marks)[by][bx] == 0 ||
-		game_get_box(game, state, bx, by) != -1
+		game_get_box(search, bx, by) != -1
 	) {
 		return FALSE;
 	}
 
-	state_init(ret, state, game->ngoals);
+	u32(*occupancy)[h][w] = (u32(*)[h][w]) search->occupancy;
+
+	(*occupancy)[py][px] = -1;
+	(*occupancy)[by][bx] = bi;
+
+	bool dead =
+		(game->patterns != NULL && pattern_deadlock(w, h, (u64(*)[h][w][8]) game->patterns, occupancy, (point){ bx, by })) ||
+		freeze_deadlock(w, h, board, marks, occupancy, (point){ bx, by }) ||
+		corral_deadlock(w, h, board, marks, occupancy, (u8(*)[h][w]) search->seen, search->queue, (point){ px, py }, (point){ bx, by });
+
+	(*occupancy)[by][bx] = -1;
+	(*occupancy)[py][px] = bi;
+
+	if (dead)
+		return FALSE;
+
+	state_init(ret, state, game->ngoals, &search->pool);
 	ret->positions[0] = (point){ px, py };
 	ret->positions[bi] = (point){ bx, by };
+	ret->hash ^= zobrist_player(game, state->positions[0]) ^ zobrist_player(game, ret->positions[0]);
+	ret->hash ^= zobrist_box(game, state->positions[bi]) ^ zobrist_box(game, ret->positions[bi]);
+
+	if ((*board)[py][px] == GOAL)
+		ret->on_goals--;
+	if ((*board)[by][bx] == GOAL)
+		ret->on_goals++;
 
 	return TRUE;
 }
 
-bool game_solve_dfs(Game *game, State *ret)
+/*
+ * Pulls the box bi from (bx, by) onto the square (px, py) of the player, who
+ * steps back to (qx, qy). This is a push played backwards.
+ */
+static bool game_pull(Search *search, State *state, u32 bx, u32 by, u32 px, u32 py, u32 qx, u32 qy, u32 bi, State *ret)
 {
-	State init_state;
-	state_init(&init_state, &game->state, game->ngoals);
+	Game *game = search->game;
+	u32 w = game->width;
+	u32 h = game->height;
 
-	TrbHashTable visited;
-	trb_hash_table_init_data(&visited, (game->ngoals + 1) * sizeof(point), 1, 0xdeadbeef, trb_jhash, (TrbCmpDataFunc) pos_cmp, &game->ngoals);
-	trb_hash_table_insert(&visited, init_state.positions, trb_get_ptr(bool, TRUE));
+	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
+	u8(*marks)[h][w] = (u8(*)[h][w]) game->marks;
 
-	TrbDeque vertices;
-	trb_deque_init(&vertices, TRUE, sizeof(State));
-	trb_deque_push_back(&vertices, &init_state);
-
-	while (vertices.len != 0) {
-		State vertex;
-		trb_deque_pop_front(&vertices, &vertex);
-
-		point pos = vertex.positions[0];
-		u32 x = pos.x;
-		u32 y = pos.y;
-
-		struct {
-			u32 px, py;
-			u32 bx, by;
-			char move_char;
-			char push_char;
-		} dirs[4] = {
-			{x - 1,  y,     x - 2, y,     'l', 'L'},
-			{ x,     y - 1, x,     y - 2, 'u', 'U'},
-			{ x + 1, y,     x + 2, y,     'r', 'R'},
-			{ x,     y + 1, x,     y + 2, 'd', 'D'},
-		};
-
-		for (u32 i = 0; i < 4; ++i) {
-			u32 px = dirs[i].px;
-			u32 py = dirs[i].py;
-			u32 bx = dirs[i].bx;
-			u32 by = dirs[i].by;
-
-			bool do_something;
-			State next;
-			char csol;
-
-			u32 bi = game_get_box(game, &vertex, px, py);
-			if (bi != -1) {
-				do_something = game_push(game, &vertex, px, py, bx, by, bi, &next);
-				csol = dirs[i].push_char;
-			} else {
-				do_something = game_move(game, &vertex, px, py, &next);
-				csol = dirs[i].move_char;
-			}
+	if (qx >= w || qy >= h)
+		return FALSE;
 
-			if (do_something) {
-				if (trb_hash_table_lookup(&visited, next.positions, NULL)) {
-					state_destroy(&next);
-					continue;
-				}
+	if (
+		(*board)[qy][qx] == '#' ||
+		(*board)[qy][qx] == 0 ||
+		(*marks)[py][px] == 0 ||
+		game_get_box(search, qx, qy) != -1
+	) {
+		return FALSE;
+	}
 
-				trb_string_push_back_c(&next.solution, csol);
+	state_init(ret, state, game->ngoals, &search->pool);
+	ret->positions[0] = (point){ qx, qy };
+	ret->positions[bi] = (point){ px, py };
+	ret->hash ^= zobrist_player(game, state->positions[0]) ^ zobrist_player(game, ret->positions[0]);
+	ret->hash ^= zobrist_box(game, state->positions[bi]) ^ zobrist_box(game, ret->positions[bi]);
 
-				if (is_solved(game, &next)) {
-					trb_hash_table_destroy(&visited, NULL, NULL);
-					trb_deque_destroy(&vertices, (TrbFreeFunc) state_destroy);
-					state_destroy(&vertex);
+	if ((*board)[by][bx] == GOAL)
+		ret->on_goals--;
+	if ((*board)[py][px] == GOAL)
+		ret->on_goals++;
 
-					*ret = next;
-					return TRUE;
-				}
+	return TRUE;
+}
 
-				trb_deque_push_back(&vertices, &next);
-				trb_hash_table_insert(&visited, next.positions, trb_get_ptr(bool, TRUE));
-			}
-		}
+static const i32 dir_dx[4] = { -1, 0, 1, 0 };
+static const i32 dir_dy[4] = { 0, -1, 0, 1 };
+static const char move_chars[4] = { 'l', 'u', 'r', 'd' };
+static const char push_chars[4] = { 'L', 'U', 'R', 'D' };
 
-		state_destroy(&vertex);
-	}
+/*
+ * Flood fills the area reachable by the player without pushing any boxes.
+ * Returns the top-left reachable square, which identifies the area.
+ */
+static point game_reach(Search *search, State *state)
+{
+	Game *game = search->game;
+	u8 *reach = search->reach;
+	u32 w = game->width;
+	u32 h = game->height;
 
-	trb_hash_table_destroy(&visited, NULL, NULL);
-	trb_deque_destroy(&vertices, (TrbFreeFunc) state_destroy);
+	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
+	u8(*reached)[h][w] = (u8(*)[h][w]) reach;
 
-	return FALSE;
-}
+	memset(reach, 0, w * h);
 
-static u32 heuristic(Game *game, State *state)
-{
-	u32 total = 0;
+	point *queue = search->queue;
+	u32 head = 0;
+	u32 tail = 0;
 
-	u32 w = game->width;
-	u32 h = game->height;
+	point min = state->positions[0];
+	(*reached)[min.y][min.x] = 1;
+	queue[tail++] = min;
+
+	while (head != tail) {
+		point pos = queue[head++];
+
+		if (pos.y < min.y || (pos.y == min.y && pos.x < min.x))
+			min = pos;
+
+		for (u32 dir = LEFT; dir <= DOWN; ++dir) {
+			u32 x = pos.x + dir_dx[dir];
+			u32 y = pos.y + dir_dy[dir];
+
+			if (x >= w || y >= h || (*reached)[y][x])
+				continue;
 
-	u32 *assignment = game->assignment;
-	u32(*distances)[game->ngoals][h][w] = (u32(*)[game->ngoals][h][w]) game->distances;
+			if ((*board)[y][x] == WALL || (*board)[y][x] == 0 || game_get_box(search, x, y) != -1)
+				continue;
 
-	for (u32 goal = 0; goal < game->ngoals; ++goal) {
-		u32 box = assignment[goal] + 1;
-		point bp = state->positions[box];
-		total += (*distances)[goal][bp.y][bp.x];
+			(*reached)[y][x] = 1;
+			queue[tail++] = (point){ x, y };
+		}
 	}
 
-	return total;
+	return min;
 }
 
-bool game_solve_astar(Game *game, State *ret)
+/*
+ * Appends the shortest walk of the player to (x, y) to the solution.
+ */
+static void game_walk(Search *search, State *state, u32 x, u32 y, TrbString *solution)
 {
-	State init_state;
-	state_init(&init_state, &game->state, game->ngoals);
-
-	TrbHashTable visited;
-	trb_hash_table_init_data(&visited, (game->ngoals + 1) * sizeof(point), 1, 0xdeadbeef, trb_jhash, (TrbCmpDataFunc) pos_cmp, &game->ngoals);
-	trb_hash_table_insert(&visited, init_state.positions, trb_get_ptr(bool, TRUE));
+	Game *game = search->game;
+	u32 w = game->width;
+	u32 h = game->height;
 
-	TrbHeap vertices;
-	trb_heap_init_data(&vertices, sizeof(State), (TrbCmpDataFunc) state_pcmp, &game->ngoals);
-	trb_heap_insert(&vertices, &init_state);
-
-	while (vertices.vector.len != 0) {
-		State vertex;
-		trb_heap_pop_front(&vertices, &vertex);
-		trb_hash_table_add(&visited, vertex.positions, trb_get_ptr(bool, TRUE));
-
-		point pos = vertex.positions[0];
-		u32 x = pos.x;
-		u32 y = pos.y;
-
-		struct {
-			u32 px, py;
-			u32 bx, by;
-			char move_char;
-			char push_char;
-		} dirs[4] = {
-			{x - 1,  y,     x - 2, y,     'l', 'L'},
-			{ x,     y - 1, x,     y - 2, 'u', 'U'},
-			{ x + 1, y,     x + 2, y,     'r', 'R'},
-			{ x,     y + 1, x,     y + 2, 'd', 'D'},
-		};
-
-		for (u32 i = 0; i < 4; ++i) {
-			u32 px = dirs[i].px;
-			u32 py = dirs[i].py;
-			u32 bx = dirs[i].bx;
-			u32 by = dirs[i].by;
-
-			bool do_something;
-			State next;
-			char csol;
-
-			u32 bi = game_get_box(game, &vertex, px, py);
-			if (bi != -1) {
-				do_something = game_push(game, &vertex, px, py, bx, by, bi, &next);
-				csol = dirs[i].push_char;
-			} else {
-				do_something = game_move(game, &vertex, px, py, &next);
-				csol = dirs[i].move_char;
-			}
+	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
 
-			if (do_something) {
-				if (trb_hash_table_lookup(&visited, next.positions, NULL)) {
-					state_destroy(&next);
-					continue;
-				}
+	u8(*came_from)[h][w] = (u8(*)[h][w]) search->seen;
+	memset(came_from, 0xff, sizeof *came_from);
 
-				trb_string_push_back_c(&next.solution, csol);
+	point *queue = search->queue;
+	u32 head = 0;
+	u32 tail = 0;
 
-				if (is_solved(game, &next)) {
-					trb_hash_table_destroy(&visited, NULL, NULL);
-					trb_heap_destroy(&vertices, (TrbFreeFunc) state_destroy);
-					state_destroy(&vertex);
+	point start = state->positions[0];
+	(*came_from)[start.y][start.x] = LEFT;
+	queue[tail++] = start;
 
-					*ret = next;
-					return TRUE;
-				}
+	while (head != tail) {
+		point pos = queue[head++];
 
-				next.distance = vertex.distance + 1;
-				next.total_distance = next.distance + heuristic(game, &next);
+		if (pos.x == x && pos.y == y)
+			break;
 
-				usize index;
+		for (u32 dir = LEFT; dir <= DOWN; ++dir) {
+			u32 nx = pos.x + dir_dx[dir];
+			u32 ny = pos.y + dir_dy[dir];
 
-				if (trb_heap_search_data(&vertices, &next, (TrbCmpDataFunc) state_cmp, &game->ngoals, &index)) {
-					State *old = trb_heap_ptr(&vertices, State, index);
+			if (nx >= w || ny >= h || (*came_from)[ny][nx] != 0xff)
+				continue;
 
-					if (next.distance < old->distance) {
-						old->distance = next.distance;
-						old->total_distance = next.total_distance;
-						trb_heap_fix(&vertices);
-					}
+			if ((*board)[ny][nx] == WALL || (*board)[ny][nx] == 0 || game_get_box(search, nx, ny) != -1)
+				continue;
 
-					state_destroy(&next);
-				} else {
-					trb_heap_insert(&vertices, &next);
-				}
-			}
+			(*came_from)[ny][nx] = dir;
+			queue[tail++] = (point){ nx, ny };
 		}
+	}
 
-		state_destroy(&vertex);
+	usize len = 0;
+	for (u32 cx = x, cy = y; cx != start.x || cy != start.y; ++len) {
+		u32 dir = (*came_from)[cy][cx];
+		cx -= dir_dx[dir];
+		cy -= dir_dy[dir];
 	}
 
-	trb_hash_table_destroy(&visited, NULL, NULL);
-	trb_heap_destroy(&vertices, (TrbFreeFunc) state_destroy);
+	/* The walk is traced backwards, so it is written from its end */
+	usize start_len = solution->len;
+	for (usize i = 0; i < len; ++i)
+		trb_string_push_back_c(solution, ' ');
 
-	return FALSE;
+	for (u32 cx = x, cy = y, i = len; i != 0; --i) {
+		u32 dir = (*came_from)[cy][cx];
+		solution->data[start_len + i - 1] = move_chars[dir];
+		cx -= dir_dx[dir];
+		cy -= dir_dy[dir];
+	}
 }
 
-bool game_solve_cbfs(Game *game, State *ret)
+/*
+ * The key under which the state is stored in the visited tables: the hash of
+ * the state, the index of the player's square and a bitset of the squares
+ * holding boxes. Boxes are interchangeable, so it doesn't matter which box
+ * went where. In the push search the player may be anywhere in its reachable
+ * area, so the area is identified by its top-left square instead.
+ */
+u8 *game_key(Search *search, State *state)
 {
-	State init_state;
-	state_init(&init_state, &game->state, game->ngoals);
+	Game *game = search->game;
+	u32 w = game->width;
+	u8 *key = search->key;
 
-	TrbHashTable visited;
-	trb_hash_table_init_data(&visited, (game->ngoals + 1) * sizeof(point), 1, 0xdeadbeef, trb_jhash, (TrbCmpDataFunc) pos_cmp, &game->ngoals);
-	trb_hash_table_insert(&visited, init_state.positions, trb_get_ptr(bool, TRUE));
+	memset(key, 0, game->keysize);
 
-	TrbHeap vertices;
-	trb_heap_init_data(&vertices, sizeof(State), (TrbCmpDataFunc) state_pcmp, &game->ngoals);
-	trb_heap_insert(&vertices, &init_state);
-
-	while (vertices.vector.len != 0) {
-		State vertex;
-		trb_heap_pop_front(&vertices, &vertex);
-		trb_hash_table_add(&visited, vertex.positions, trb_get_ptr(bool, TRUE));
-
-		point pos = vertex.positions[0];
-		u32 x = pos.x;
-		u32 y = pos.y;
-
-		struct {
-			u32 px, py;
-			u32 bx, by;
-			char move_char;
-			char push_char;
-		} dirs[4] = {
-			{x - 1,  y,     x - 2, y,     'l', 'L'},
-			{ x,     y - 1, x,     y - 2, 'u', 'U'},
-			{ x + 1, y,     x + 2, y,     'r', 'R'},
-			{ x,     y + 1, x,     y + 2, 'd', 'D'},
-		};
-
-		for (u32 i = 0; i < 4; ++i) {
-			u32 px = dirs[i].px;
-			u32 py = dirs[i].py;
-			u32 bx = dirs[i].bx;
-			u32 by = dirs[i].by;
-
-			bool do_something;
-			State next;
-			char csol;
-
-			u32 bi = game_get_box(game, &vertex, px, py);
-			if (bi != -1) {
-				do_something = game_push(game, &vertex, px, py, bx, by, bi, &next);
-				csol = dirs[i].push_char;
-			} else {
-				do_something = game_move(game, &vertex, px, py, &next);
-				csol = dirs[i].move_char;
-			}
+	point player = state->positions[0];
+	u64 hash = state->hash;
 
-			if (do_something) {
-				if (trb_hash_table_lookup(&visited, next.positions, NULL)) {
-					state_destroy(&next);
-					continue;
-				}
+	if (game->search == PUSH_SEARCH) {
+		search_place(search, state);
+		player = game_reach(search, state);
+		search_clear(search, state);
 
-				trb_string_push_back_c(&next.solution, csol);
+		hash ^= zobrist_player(game, state->positions[0]) ^ zobrist_player(game, player);
+	}
 
-				if (is_solved(game, &next)) {
-					trb_hash_table_destroy(&visited, NULL, NULL);
-					trb_heap_destroy(&vertices, (TrbFreeFunc) state_destroy);
-					state_destroy(&vertex);
+	memcpy(key, &hash, sizeof hash);
 
-					*ret = next;
-					return TRUE;
-				}
+	u32 cell = game->cells[player.y * w + player.x];
+	key[sizeof hash] = cell;
 
-				next.total_distance = vertex.distance + 1 + heuristic(game, &next);
+	if (game->cellbytes > 1)
+		key[sizeof hash + 1] = cell >> 8;
 
-				if (!trb_heap_search_data(&vertices, &next, (TrbCmpDataFunc) state_cmp, &game->ngoals, NULL)) {
-					trb_heap_insert(&vertices, &next);
-				} else {
-					state_destroy(&next);
-				}
-			}
-		}
+	u8 *boxes = key + sizeof hash + game->cellbytes;
 
-		state_destroy(&vertex);
+	for (u32 i = 1; i <= game->ngoals; ++i) {
+		point box = state->positions[i];
+		cell = game->cells[box.y * w + box.x];
+		boxes[cell >> 3] |= 1 << (cell & 7);
 	}
 
-	trb_hash_table_destroy(&visited, NULL, NULL);
-	trb_heap_destroy(&vertices, (TrbFreeFunc) state_destroy);
+	return key;
+}
 
-	return FALSE;
+static u32 move_dir(char move)
+{
+	for (u32 dir = LEFT; dir <= DOWN; ++dir) {
+		if (move == move_chars[dir] || move == push_chars[dir])
+			return dir;
+	}
+
+	return -1;
 }
 
-void game_parse_board(Game *game, u32 w, u32 h, const char *str)
+/*
+ * Generates all states following the given one. In the move search these are
+ * the single steps of the player, in the push search these are the pushes of
+ * every box the player can walk up to.
+ */
+u32 game_successors(Search *search, State *state, State *ret)
 {
-	game->width = w;
-	game->height = h;
+	Game *game = search->game;
+	u32 n = 0;
 
-	game->board = calloc(w * h, 1);
-	assert(game->board);
+	search->stats.expanded++;
+	search_place(search, state);
 
-	game->marks = calloc(w * h, 1);
-	assert(game->marks);
+	if (game->search == PUSH_SEARCH) {
+		u32 w = game->width;
+		u8(*reached)[game->height][w] = (u8(*)[game->height][w]) search->reach;
 
-	for (u32 i = 0; str[i]; ++i) {
-		switch (str[i]) {
-		case WALL:
-			game->board[i] = WALL;
-			continue;
+		game_reach(search, state);
 
-		case BOX:
-		case PLAYER:
-		case FLOOR:
-			game->board[i] = FLOOR;
-			continue;
+		for (u32 bi = 1; bi <= game->ngoals; ++bi) {
+			point box = state->positions[bi];
 
-		case BOX_ON_GOAL:
-		case GOAL:
-		case PLAYER_ON_GOAL:
-			game->ngoals++;
-			game->board[i] = GOAL;
-			continue;
+			for (u32 dir = LEFT; dir <= DOWN; ++dir) {
+				u32 px = box.x - dir_dx[dir];
+				u32 py = box.y - dir_dy[dir];
 
-		default:
-			continue;
-		}
-	}
+				if (px >= w || py >= game->height || !(*reached)[py][px])
+					continue;
 
-	state_init(&game->state, NULL, game->ngoals);
-	game->goals = calloc(game->ngoals, sizeof(point));
-	assert(game->goals != NULL);
+				u32 bx = box.x + dir_dx[dir];
+				u32 by = box.y + dir_dy[dir];
 
-	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
+				if (game_push(search, state, box.x, box.y, bx, by, bi, &ret[n])) {
+					ret[n].move = push_chars[dir];
+					n++;
+				}
+			}
+		}
 
-	for (u32 y = 0, i = 0, j = 1, k = 0; y < h; ++y) {
-		for (u32 x = 0; x < w; ++x, ++i) {
-			if ((*board)[y][x] == GOAL)
-				mark(game, x, y);
+		search_clear(search, state);
+		search->stats.generated += n;
+		return n;
+	}
 
-			switch (str[i]) {
-			case GOAL:
-				game->goals[k++] = (point){ x, y };
-				continue;
+	point pos = state->positions[0];
 
-			case PLAYER_ON_GOAL:
-				game->goals[k++] = (point){ x, y };
-			case PLAYER:
-				game->state.positions[0] = (point){ x, y };
-				continue;
+	for (u32 dir = LEFT; dir <= DOWN; ++dir) {
+		u32 px = pos.x + dir_dx[dir];
+		u32 py = pos.y + dir_dy[dir];
+		u32 bx = px + dir_dx[dir];
+		u32 by = py + dir_dy[dir];
 
-			case BOX_ON_GOAL:
-				game->goals[k++] = (point){ x, y };
-			case BOX:
-				game->state.positions[j++] = (point){ x, y };
-				continue;
+		u32 bi = game_get_box(search, px, py);
 
-			default:
-				continue;
-			}
+		if (bi != -1) {
+			if (game_push(search, state, px, py, bx, by, bi, &ret[n]))
+				ret[n++].move = push_chars[dir];
+		} else {
+			if (game_move(search, state, px, py, &ret[n]))
+				ret[n++].move = move_chars[dir];
 		}
 	}
+
+	search_clear(search, state);
+	search->stats.generated += n;
+	return n;
 }
 
-void game_calc_distances(Game *game, int type)
+/*
+ * Generates all states the given one can be reached from by a single push.
+ * The move of each of them is the push that leads back to the given state.
+ */
+static u32 game_predecessors(Search *search, State *state, State *ret)
 {
+	Game *game = search->game;
 	u32 w = game->width;
 	u32 h = game->height;
+	u32 n = 0;
 
-	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
-	u32(*distances)[game->ngoals][h][w] = malloc(sizeof *distances);
-	assert(distances != NULL);
+	u8(*reached)[h][w] = (u8(*)[h][w]) search->reach;
 
-	switch (type) {
-	case PULL_GOAL_DIST:
-		pull_goal_distance(game->goals, game->state.positions, w, h, board, game->ngoals, distances);
-		break;
-	case MANHATTAN_DIST:
-		manhattan_distance(game->goals, game->state.positions, w, h, board, game->ngoals, distances);
-		break;
-	case PYTHAGOREAN_DIST:
-	default:
-		pythagorean_distance(game->goals, game->state.positions, w, h, board, game->ngoals, distances);
-		break;
+	search->stats.expanded++;
+	search_place(search, state);
+	game_reach(search, state);
+
+	for (u32 bi = 1; bi <= game->ngoals; ++bi) {
+		point box = state->positions[bi];
+
+		for (u32 dir = LEFT; dir <= DOWN; ++dir) {
+			u32 px = box.x - dir_dx[dir];
+			u32 py = box.y - dir_dy[dir];
+
+			if (px >= w || py >= h || !(*reached)[py][px])
+				continue;
+
+			u32 qx = px - dir_dx[dir];
+			u32 qy = py - dir_dy[dir];
+
+			if (game_pull(search, state, box.x, box.y, px, py, qx, qy, bi, &ret[n])) {
+				ret[n].move = push_chars[dir];
+				n++;
+			}
+		}
 	}
 
-	game->distances = (u32 *) distances;
+	search_clear(search, state);
+	search->stats.generated += n;
+	return n;
 }
 
-void game_do_assignment(Game *game, int type)
+/*
+ * Rebuilds the moves leading to the given node by following the parent
+ * links back to the initial state.
+ */
+void game_solution(Search *search, u32 node, TrbString *ret)
 {
-	u32 w = game->width;
-	u32 h = game->height;
+	Game *game = search->game;
+	TrbVector *nodes = &search->nodes;
 
-	u32(*distances)[game->ngoals][h][w] = (u32(*)[game->ngoals][h][w]) game->distances;
-	u32(*transformed)[game->ngoals][game->ngoals] = malloc(sizeof *transformed);
-	assert(transformed != NULL);
+	u32 depth = 0;
+	for (u32 i = node; i != U32_MAX; i = trb_vector_ptr(nodes, State, i)->parent)
+		depth++;
 
-	transform_distances(game->state.positions, w, h, game->ngoals, distances, transformed);
+	u32 *chain = malloc(depth * sizeof(u32));
+	assert(chain != NULL);
 
-	switch (type) {
-	case HUNGARIAN_ASSIGN:
-		game->assignment = hungarian_assignment(game->ngoals, transformed);
-		break;
-	case GREEDY_ASSIGN:
-		game->assignment = greedy_assignment(game->ngoals, transformed);
-		break;
-	default:
-	case CLOSEST_ASSIGN:
-		game->assignment = closest_assignment(game->ngoals, transformed);
-		break;
-	}
+	for (u32 i = node, j = depth; i != U32_MAX; i = trb_vector_ptr(nodes, State, i)->parent)
+		chain[--j] = i;
+
+	trb_string_init0(ret);
+
+	for (u32 i = 1; i < depth; ++i) {
+		State *prev = trb_vector_ptr(nodes, State, chain[i - 1]);
+		State *cur = trb_vector_ptr(nodes, State, chain[i]);
+
+		if (game->search == PUSH_SEARCH) {
+			u32 dir = move_dir(cur->move);
+			point pos = cur->positions[0];
 
-	free(transformed);
+			search_place(search, prev);
+			game_walk(search, prev, pos.x - dir_dx[dir], pos.y - dir_dy[dir], ret);
+			search_clear(search, prev);
+		}
+
+		trb_string_push_back_c(ret, cur->move);
+	}
+
+	free(chain);
+}
+
+bool game_solve_dfs(Game *game, TrbString *ret)
+{
+	if (game->threads > 1)
+		return parallel_bfs(game, ret);
+
+	State succs[4 * game->ngoals + 4];
+
+	Search search;
+	search_init(&search, game);
+	State *init_state = trb_vector_ptr(&search.nodes, State, 0);
+
+	TrbHashTable visited;
+	trb_hash_table_init_data(&visited, game->keysize, 1, 0xdeadbeef, key_hash, (TrbCmpDataFunc) key_cmp, &game->keysize);
+	trb_hash_table_insert(&visited, game_key(&search, init_state), trb_get_ptr(bool, TRUE));
+
+	TrbDeque vertices;
+	trb_deque_init(&vertices, TRUE, sizeof(u32));
+	trb_deque_push_back(&vertices, trb_get_ptr(u32, 0));
+
+	while (vertices.len != 0 && !game_cancelled(game)) {
+		u32 index;
+		trb_deque_pop_front(&vertices, &index);
+
+		State vertex = trb_vector_get(&search.nodes, State, index);
+		u32 nsuccs = game_successors(&search, &vertex, succs);
+
+		for (u32 i = 0; i < nsuccs; ++i) {
+			State *next = &succs[i];
+			u8 *key = game_key(&search, next);
+
+			if (trb_hash_table_lookup(&visited, key, NULL)) {
+				search.stats.duplicates++;
+				pool_free(&search.pool, next->positions);
+				continue;
+			}
+
+			next->parent = index;
+			trb_vector_push_back(&search.nodes, next);
+
+			if (is_solved(game, next)) {
+				game_solution(&search, search.nodes.len - 1, ret);
+
+				while (++i < nsuccs)
+					pool_free(&search.pool, succs[i].positions);
+
+				trb_hash_table_destroy(&visited, NULL, NULL);
+				trb_deque_destroy(&vertices, NULL);
+				search_destroy(&search);
+
+				return TRUE;
+			}
+
+			trb_deque_push_back(&vertices, trb_get_ptr(u32, search.nodes.len - 1));
+			trb_hash_table_insert(&visited, key, trb_get_ptr(bool, TRUE));
+			stats_peak(&search.stats.peak_open, vertices.len);
+			search_charge(&search, search.nodes.len, vertices.len * sizeof(u32));
+		}
+	}
+
+	trb_hash_table_destroy(&visited, NULL, NULL);
+	trb_deque_destroy(&vertices, NULL);
+	search_destroy(&search);
+
+	return FALSE;
+}
+
+/*
+ * Estimates the pushes left by matching the boxes with the goals. The
+ * Hungarian matching of a state is derived from the one of its parent by
+ * repairing the row of the box that moved. Returns U32_MAX if the boxes can't
+ * all reach distinct goals.
+ */
+u32 game_heuristic(Search *search, State *parent, State *state)
+{
+	Game *game = search->game;
+	u32 n = game->ngoals;
+	u32 w = game->width;
+	u32 h = game->height;
+
+	u32(*distances)[n][h][w] = (u32(*)[n][h][w]) game->distances;
+	u32(*costs)[n][n] = (u32(*)[n][n]) search->costs;
+
+	search->stats.evaluations++;
+	transform_distances(state->positions, w, h, n, distances, costs);
+
+	if (game->assign == GREEDY_ASSIGN) {
+		u32 matching[n];
+		greedy_assignment(&search->greedy, n, costs, matching);
+
+		u32 total = 0;
+		for (u32 goal = 0; goal < n; ++goal) {
+			u32 cost = (*costs)[goal][matching[goal]];
+			total += cost == U32_MAX ? w * h : cost;
+		}
+
+		return total;
+	}
+
+	if (game->assign == CLOSEST_ASSIGN) {
+		u32 matching[n];
+		closest_assignment(&search->closest, n, costs, matching);
+
+		u32 total = 0;
+		for (u32 goal = 0; goal < n; ++goal) {
+			u32 cost = (*costs)[goal][matching[goal]];
+			total += cost == U32_MAX ? w * h : cost;
+		}
+
+		return total;
+	}
+
+	i32 *goal_pot = (i32 *) (state->positions + n + 1);
+	i32 *box_pot = goal_pot + n;
+	u32 *matching = (u32 *) (box_pot + n);
+
+	if (parent == NULL)
+		return hungarian_assignment(&search->hungarian, n, costs, goal_pot, box_pot, matching);
+
+	memcpy(goal_pot, parent->positions + n + 1, 3 * n * sizeof(u32));
+
+	for (u32 box = 0; box < n; ++box) {
+		point from = parent->positions[box + 1];
+		point to = state->positions[box + 1];
+
+		if (from.x != to.x || from.y != to.y)
+			return hungarian_update(&search->hungarian, n, costs, box, goal_pot, box_pot, matching);
+	}
+
+	u32 total = 0;
+	for (u32 goal = 0; goal < n; ++goal)
+		total += (*costs)[goal][matching[goal]];
+
+	return total;
+}
+
+bool game_solve_astar(Game *game, TrbString *ret)
+{
+	if (game->threads > 1)
+		return parallel_astar(game, ret);
+
+	State succs[4 * game->ngoals + 4];
+
+	Search search;
+	search_init(&search, game);
+	State *init_state = trb_vector_ptr(&search.nodes, State, 0);
+
+	init_state->total_distance = game_heuristic(&search, NULL, init_state);
+	if (init_state->total_distance == U32_MAX) {
+		search_destroy(&search);
+		return FALSE;
+	}
+
+	/*
+	 * Every state that has ever been put into the heap has a node holding
+	 * the best known distance to it. The heap itself is never searched: when
+	 * a shorter path is found, the node is updated and inserted again, and
+	 * the outdated heap entries are dropped once popped.
+	 */
+	TrbHashTable seen;
+	trb_hash_table_init_data(&seen, game->keysize, sizeof(u32), 0xdeadbeef, key_hash, (TrbCmpDataFunc) key_cmp, &game->keysize);
+	trb_hash_table_insert(&seen, game_key(&search, init_state), trb_get_ptr(u32, 0));
+
+	TrbHeap vertices;
+	trb_heap_init(&vertices, sizeof(OpenEntry), (TrbCmpFunc) open_pcmp);
+	trb_heap_insert(&vertices, &(OpenEntry){ init_state->total_distance, 0, 0 });
+
+	while (vertices.vector.len != 0 && !game_cancelled(game)) {
+		OpenEntry entry;
+		trb_heap_pop_front(&vertices, &entry);
+
+		State *vertex_node = trb_vector_ptr(&search.nodes, State, entry.node);
+		if (vertex_node->closed || entry.total_distance != vertex_node->total_distance)
+			continue;
+
+		vertex_node->closed = TRUE;
+
+		State vertex = *vertex_node;
+		u32 nsuccs = game_successors(&search, &vertex, succs);
+
+		for (u32 i = 0; i < nsuccs; ++i) {
+			State *next = &succs[i];
+			u8 *key = game_key(&search, next);
+
+			next->parent = entry.node;
+			next->distance = vertex.distance + 1;
+
+			u32 index;
+			bool found = trb_hash_table_lookup(&seen, key, &index);
+
+			if (found) {
+				State *old = trb_vector_ptr(&search.nodes, State, index);
+
+				if (old->closed || next->distance >= old->distance) {
+					search.stats.duplicates++;
+					pool_free(&search.pool, next->positions);
+					continue;
+				}
+			}
+
+			if (is_solved(game, next)) {
+				trb_vector_push_back(&search.nodes, next);
+				game_solution(&search, search.nodes.len - 1, ret);
+
+				while (++i < nsuccs)
+					pool_free(&search.pool, succs[i].positions);
+
+				trb_hash_table_destroy(&seen, NULL, NULL);
+				trb_heap_destroy(&vertices, NULL);
+				search_destroy(&search);
+
+				return TRUE;
+			}
+
+			u32 estimate = game_heuristic(&search, &vertex, next);
+			if (estimate == U32_MAX) {
+				pool_free(&search.pool, next->positions);
+				continue;
+			}
+
+			next->total_distance = next->distance + estimate;
+
+			if (found) {
+				State *old = trb_vector_ptr(&search.nodes, State, index);
+
+				/* The player may stand elsewhere in the same area after a push */
+				old->positions[0] = next->positions[0];
+				old->hash = next->hash;
+				old->parent = next->parent;
+				old->move = next->move;
+				old->distance = next->distance;
+				old->total_distance = next->total_distance;
+
+				pool_free(&search.pool, next->positions);
+			} else {
+				index = search.nodes.len;
+				trb_vector_push_back(&search.nodes, next);
+				trb_hash_table_insert(&seen, key, &index);
+			}
+
+			trb_heap_insert(&vertices, &(OpenEntry){ next->total_distance, next->distance, index });
+			stats_peak(&search.stats.peak_open, vertices.vector.len);
+			search_charge(&search, search.nodes.len, vertices.vector.len * sizeof(OpenEntry));
+		}
+	}
+
+	trb_hash_table_destroy(&seen, NULL, NULL);
+	trb_heap_destroy(&vertices, NULL);
+	search_destroy(&search);
+
+	return FALSE;
+}
+
+bool game_solve_cbfs(Game *game, TrbString *ret)
+{
+	State succs[4 * game->ngoals + 4];
+
+	Search search;
+	search_init(&search, game);
+	State *init_state = trb_vector_ptr(&search.nodes, State, 0);
+
+	init_state->total_distance = game_heuristic(&search, NULL, init_state);
+	if (init_state->total_distance == U32_MAX) {
+		search_destroy(&search);
+		return FALSE;
+	}
+
+	TrbHashTable visited;
+	trb_hash_table_init_data(&visited, game->keysize, 1, 0xdeadbeef, key_hash, (TrbCmpDataFunc) key_cmp, &game->keysize);
+	trb_hash_table_insert(&visited, game_key(&search, init_state), trb_get_ptr(bool, TRUE));
+
+	TrbHeap vertices;
+	trb_heap_init_data(&vertices, sizeof(u32), (TrbCmpDataFunc) node_pcmp, &search.nodes);
+	trb_heap_insert(&vertices, trb_get_ptr(u32, 0));
+
+	while (vertices.vector.len != 0 && !game_cancelled(game)) {
+		u32 index;
+		trb_heap_pop_front(&vertices, &index);
+
+		State vertex = trb_vector_get(&search.nodes, State, index);
+		u32 nsuccs = game_successors(&search, &vertex, succs);
+
+		for (u32 i = 0; i < nsuccs; ++i) {
+			State *next = &succs[i];
+			u8 *key = game_key(&search, next);
+
+			if (trb_hash_table_lookup(&visited, key, NULL)) {
+				search.stats.duplicates++;
+				pool_free(&search.pool, next->positions);
+				continue;
+			}
+
+			u32 estimate = game_heuristic(&search, &vertex, next);
+			if (estimate == U32_MAX) {
+				trb_hash_table_insert(&visited, key, trb_get_ptr(bool, TRUE));
+				pool_free(&search.pool, next->positions);
+				continue;
+			}
+
+			next->parent = index;
+			next->total_distance = vertex.distance + 1 + estimate;
+			trb_vector_push_back(&search.nodes, next);
+
+			if (is_solved(game, next)) {
+				game_solution(&search, search.nodes.len - 1, ret);
+
+				while (++i < nsuccs)
+					pool_free(&search.pool, succs[i].positions);
+
+				trb_hash_table_destroy(&visited, NULL, NULL);
+				trb_heap_destroy(&vertices, NULL);
+				search_destroy(&search);
+
+				return TRUE;
+			}
+
+			trb_heap_insert(&vertices, trb_get_ptr(u32, search.nodes.len - 1));
+			trb_hash_table_insert(&visited, key, trb_get_ptr(bool, TRUE));
+			stats_peak(&search.stats.peak_open, vertices.vector.len);
+			search_charge(&search, search.nodes.len, vertices.vector.len * sizeof(u32));
+		}
+	}
+
+	trb_hash_table_destroy(&visited, NULL, NULL);
+	trb_heap_destroy(&vertices, NULL);
+	search_destroy(&search);
+
+	return FALSE;
+}
+
+/*
+ * Joins the pushes leading from the initial state to the forward node with
+ * the pushes undoing the pulls on the way back from the backward node.
+ */
+static void game_bidir_solution(Search *search, u32 forward, u32 backward, TrbString *ret)
+{
+	Game *game = search->game;
+	TrbVector *nodes = &search->nodes;
+
+	game_solution(search, forward, ret);
+
+	point positions[game->ngoals + 1];
+	memcpy(positions, trb_vector_ptr(nodes, State, forward)->positions, sizeof positions);
+
+	State current = { .positions = positions };
+
+	for (u32 i = backward; trb_vector_ptr(nodes, State, i)->parent != U32_MAX;) {
+		State *node = trb_vector_ptr(nodes, State, i);
+		point pos = node->positions[0];
+		u32 dir = move_dir(node->move);
+
+		search_place(search, &current);
+		game_walk(search, &current, pos.x, pos.y, ret);
+		search_clear(search, &current);
+
+		trb_string_push_back_c(ret, node->move);
+
+		i = node->parent;
+		memcpy(positions, trb_vector_ptr(nodes, State, i)->positions, sizeof positions);
+		positions[0] = (point){ pos.x + dir_dx[dir], pos.y + dir_dy[dir] };
+	}
+}
+
+/*
+ * Searches forwards with pushes from the initial state and backwards with
+ * pulls from the solved one, one breadth-first layer of the smaller frontier
+ * at a time, until a state turns up on both sides. The player may finish in
+ * any area around the boxes on the goals, so the backward search starts from
+ * all of them.
+ */
+static bool bidir_search(Game *game, TrbString *ret)
+{
+	u32 w = game->width;
+	u32 h = game->height;
+	u32 n = game->ngoals;
+
+	for (u32 i = 0; i < n; ++i) {
+		point goal = game->goals[i];
+
+		if (game->cells[goal.y * w + goal.x] == U32_MAX)
+			return FALSE;
+	}
+
+	State succs[4 * n + 4];
+
+	Search search;
+	search_init(&search, game);
+
+	if (is_solved(game, trb_vector_ptr(&search.nodes, State, 0))) {
+		trb_string_init0(ret);
+		search_destroy(&search);
+		return TRUE;
+	}
+
+	TrbHashTable seen[2];
+	TrbDeque frontier[2];
+
+	for (u32 side = 0; side < 2; ++side) {
+		trb_hash_table_init_data(&seen[side], game->keysize, sizeof(u32), 0xdeadbeef, key_hash, (TrbCmpDataFunc) key_cmp, &game->keysize);
+		trb_deque_init(&frontier[side], TRUE, sizeof(u32));
+	}
+
+	trb_hash_table_insert(&seen[0], game_key(&search, trb_vector_ptr(&search.nodes, State, 0)), trb_get_ptr(u32, 0));
+	trb_deque_push_back(&frontier[0], trb_get_ptr(u32, 0));
+
+	point goal_positions[n + 1];
+	State goal_state = { .positions = goal_positions, .on_goals = n };
+
+	u64 boxes_hash = 0;
+	for (u32 i = 0; i < n; ++i) {
+		goal_positions[i + 1] = game->goals[i];
+		boxes_hash ^= zobrist_box(game, game->goals[i]);
+	}
+
+	u8(*covered)[h][w] = calloc(1, sizeof *covered);
+	assert(covered != NULL);
+
+	point *starts = malloc(w * h * sizeof(point));
+	assert(starts != NULL);
+
+	u32 nstarts = 0;
+
+	search_place(&search, &goal_state);
+
+	for (u32 y = 0; y < h; ++y) {
+		for (u32 x = 0; x < w; ++x) {
+			if (game->cells[y * w + x] == U32_MAX || (*covered)[y][x] || game_get_box(&search, x, y) != -1)
+				continue;
+
+			goal_positions[0] = (point){ x, y };
+			game_reach(&search, &goal_state);
+
+			for (u32 i = 0; i < w * h; ++i)
+				((u8 *) covered)[i] |= search.reach[i];
+
+			starts[nstarts++] = (point){ x, y };
+		}
+	}
+
+	search_clear(&search, &goal_state);
+	free(covered);
+
+	bool solved = FALSE;
+
+	for (u32 i = 0; i < nstarts && !solved; ++i) {
+		goal_positions[0] = starts[i];
+		goal_state.hash = boxes_hash ^ zobrist_player(game, starts[i]);
+
+		State root;
+		state_init(&root, &goal_state, n, &search.pool);
+
+		u8 *key = game_key(&search, &root);
+		u32 index = search.nodes.len;
+		u32 meet;
+
+		trb_vector_push_back(&search.nodes, &root);
+
+		if (trb_hash_table_lookup(&seen[0], key, &meet)) {
+			game_bidir_solution(&search, meet, index, ret);
+			solved = TRUE;
+		}
+
+		trb_hash_table_insert(&seen[1], key, &index);
+		trb_deque_push_back(&frontier[1], &index);
+	}
+
+	free(starts);
+
+	while (!solved && frontier[0].len != 0 && frontier[1].len != 0 && !game_cancelled(game)) {
+		u32 side = frontier[0].len <= frontier[1].len ? 0 : 1;
+		usize layer = frontier[side].len;
+
+		while (!solved && layer-- != 0) {
+			u32 index;
+			trb_deque_pop_front(&frontier[side], &index);
+
+			State vertex = trb_vector_get(&search.nodes, State, index);
+			u32 nsuccs = side == 0 ? game_successors(&search, &vertex, succs) : game_predecessors(&search, &vertex, succs);
+
+			for (u32 i = 0; i < nsuccs; ++i) {
+				State *next = &succs[i];
+
+				if (solved) {
+					pool_free(&search.pool, next->positions);
+					continue;
+				}
+
+				u8 *key = game_key(&search, next);
+
+				if (trb_hash_table_lookup(&seen[side], key, NULL)) {
+					search.stats.duplicates++;
+					pool_free(&search.pool, next->positions);
+					continue;
+				}
+
+				u32 node = search.nodes.len;
+				u32 meet;
+
+				next->parent = index;
+				trb_vector_push_back(&search.nodes, next);
+
+				if (trb_hash_table_lookup(&seen[!side], key, &meet)) {
+					if (side == 0)
+						game_bidir_solution(&search, node, meet, ret);
+					else
+						game_bidir_solution(&search, meet, node, ret);
+
+					solved = TRUE;
+					continue;
+				}
+
+				trb_hash_table_insert(&seen[side], key, &node);
+				trb_deque_push_back(&frontier[side], &node);
+			}
+		}
+
+		stats_peak(&search.stats.peak_open, frontier[0].len + frontier[1].len);
+		search_charge(&search, search.nodes.len, (frontier[0].len + frontier[1].len) * sizeof(u32));
+	}
+
+	for (u32 side = 0; side < 2; ++side) {
+		trb_hash_table_destroy(&seen[side], NULL, NULL);
+		trb_deque_destroy(&frontier[side], NULL);
+	}
+
+	search_destroy(&search);
+
+	return solved;
+}
+
+/* Pulls only undo pushes, so both halves search over pushes whatever the game is set to */
+bool game_solve_bidir(Game *game, TrbString *ret)
+{
+	int search = game->search;
+	game->search = PUSH_SEARCH;
+
+	bool solved = bidir_search(game, ret);
+	game->search = search;
+
+	return solved;
+}
+
+/*
+ * A state on the path of the depth-first search. Its successors are kept
+ * together in one vector, from first up to first + count.
+ */
+typedef struct {
+	State state;
+	u32 first;
+	u32 count;
+	u32 next;
+	u32 least;
+	u32 lower;
+} Frame;
+
+/*
+ * Transposition table entries remember the smallest distance a state was
+ * reached with in an iteration and the best lower bound on the distance left
+ * from it, which carries over to later iterations.
+ */
+typedef struct {
+	u32 g;
+	u32 h;
+	u32 iteration;
+	u8 key[];
+} TableEntry;
+
+typedef struct {
+	u8 *entries;
+	usize entry_size;
+	usize len;
+} Transpositions;
+
+static TableEntry *transpositions_slot(Transpositions *table, const u8 *key)
+{
+	u64 hash;
+	memcpy(&hash, key, sizeof hash);
+
+	return (TableEntry *) (table->entries + (hash % table->len) * table->entry_size);
+}
+
+static bool transpositions_match(Game *game, TableEntry *entry, const u8 *key)
+{
+	return entry->iteration != 0 && memcmp(entry->key, key, game->keysize) == 0;
+}
+
+/*
+ * Iterative deepening A*. Each iteration is a depth-first search cut off at
+ * a bound on the estimated total distance, the next bound being the smallest
+ * estimate that was cut off. Memory stays within game->memory, or half of the
+ * memory limit if that is less: the path lives on an explicit stack and
+ * transpositions go into a fixed-size table whose entries are simply
+ * overwritten on collisions.
+ */
+bool game_solve_idastar(Game *game, TrbString *ret)
+{
+	State succs[4 * game->ngoals + 4];
+
+	Search search;
+	search_init(&search, game);
+	State *init_state = trb_vector_ptr(&search.nodes, State, 0);
+
+	u32 bound = game_heuristic(&search, NULL, init_state);
+	if (bound == U32_MAX) {
+		search_destroy(&search);
+		return FALSE;
+	}
+
+	/* The table only saves work, so it is made to fit in half of the memory limit */
+	usize memory = game->memory;
+	if (game->memory_limit != 0 && memory > game->memory_limit / 2)
+		memory = game->memory_limit / 2;
+
+	Transpositions table;
+	table.entry_size = (sizeof(TableEntry) + game->keysize + 7) & ~(usize) 7;
+	table.len = memory / table.entry_size;
+
+	if (table.len == 0)
+		table.len = 1;
+
+	table.entries = calloc(table.len, table.entry_size);
+	assert(table.entries != NULL);
+
+	usize table_bytes = table.len * table.entry_size;
+	search_charge(&search, 0, table_bytes);
+
+	TrbVector frames;
+	trb_vector_init(&frames, FALSE, sizeof(Frame));
+
+	TrbVector children;
+	trb_vector_init(&children, FALSE, sizeof(State));
+
+	bool solved = FALSE;
+
+	for (u32 iteration = 1; !solved && bound != U32_MAX && !game_cancelled(game); ++iteration) {
+		Frame root = { .state = *init_state, .least = U32_MAX, .lower = U32_MAX };
+		root.count = game_successors(&search, &root.state, succs);
+
+		for (u32 i = 0; i < root.count; ++i)
+			trb_vector_push_back(&children, &succs[i]);
+
+		trb_vector_push_back(&frames, &root);
+
+		while (!solved && frames.len != 0 && !game_cancelled(game)) {
+			Frame *top = trb_vector_ptr(&frames, Frame, frames.len - 1);
+
+			if (top->next == top->count) {
+				Frame done = *top;
+				trb_vector_pop_back(&frames, NULL);
+
+				for (u32 i = 0; i < done.count; ++i) {
+					State child;
+					trb_vector_pop_back(&children, &child);
+					pool_free(&search.pool, child.positions);
+				}
+
+				if (frames.len == 0) {
+					bound = done.least;
+					break;
+				}
+
+				/* Everything below the state has been cut off, so its bound can be raised */
+				u8 *key = game_key(&search, &done.state);
+				TableEntry *entry = transpositions_slot(&table, key);
+
+				if (transpositions_match(game, entry, key)) {
+					u32 learned = done.lower == U32_MAX ? U32_MAX : done.lower - done.state.distance;
+
+					if (learned > entry->h)
+						entry->h = learned;
+				}
+
+				Frame *parent = trb_vector_ptr(&frames, Frame, frames.len - 1);
+
+				if (done.least < parent->least)
+					parent->least = done.least;
+				if (done.lower < parent->lower)
+					parent->lower = done.lower;
+
+				continue;
+			}
+
+			State child = trb_vector_get(&children, State, top->first + top->next);
+			top->next++;
+
+			child.distance = top->state.distance + 1;
+
+			u32 estimate = game_heuristic(&search, &top->state, &child);
+			if (estimate == U32_MAX)
+				continue;
+
+			u8 *key = game_key(&search, &child);
+			TableEntry *entry = transpositions_slot(&table, key);
+
+			if (transpositions_match(game, entry, key)) {
+				if (entry->h > estimate)
+					estimate = entry->h;
+
+				if (estimate == U32_MAX)
+					continue;
+
+				if (entry->iteration == iteration && entry->g <= child.distance) {
+					search.stats.duplicates++;
+
+					if (child.distance + estimate < top->lower)
+						top->lower = child.distance + estimate;
+					continue;
+				}
+			}
+
+			child.total_distance = child.distance + estimate;
+
+			if (child.total_distance > bound) {
+				if (child.total_distance < top->least)
+					top->least = child.total_distance;
+				if (child.total_distance < top->lower)
+					top->lower = child.total_distance;
+				continue;
+			}
+
+			if (is_solved(game, &child)) {
+				for (u32 i = 1; i < frames.len; ++i) {
+					State node = trb_vector_get(&frames, Frame, i).state;
+					node.parent = search.nodes.len - 1;
+					trb_vector_push_back(&search.nodes, &node);
+				}
+
+				child.parent = search.nodes.len - 1;
+				trb_vector_push_back(&search.nodes, &child);
+				game_solution(&search, search.nodes.len - 1, ret);
+
+				solved = TRUE;
+				break;
+			}
+
+			/* The table is all that is remembered of the visited states, so its filled slots count them */
+			if (entry->iteration == 0)
+				search.stats.peak_visited++;
+
+			entry->g = child.distance;
+			entry->h = estimate;
+			entry->iteration = iteration;
+			memcpy(entry->key, key, game->keysize);
+
+			Frame frame = { .state = child, .first = children.len, .least = U32_MAX, .lower = U32_MAX };
+			frame.count = game_successors(&search, &frame.state, succs);
+
+			for (u32 i = 0; i < frame.count; ++i)
+				trb_vector_push_back(&children, &succs[i]);
+
+			trb_vector_push_back(&frames, &frame);
+			stats_peak(&search.stats.peak_open, children.len);
+			search_charge(&search, 0, table_bytes + frames.len * sizeof(Frame) + children.len * sizeof(State));
+		}
+	}
+
+	trb_vector_destroy(&frames, NULL);
+	trb_vector_destroy(&children, NULL);
+	free(table.entries);
+	search_destroy(&search);
+
+	return solved;
+}
+
+/*
+ * Numbers the squares inside the level, which are the only ones the player
+ * and the boxes can ever occupy, so that a state packs into a few bytes.
+ */
+static void game_index_cells(Game *game)
+{
+	u32 w = game->width;
+	u32 h = game->height;
+
+	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
+	u32(*cells)[h][w] = malloc(sizeof *cells);
+	assert(cells != NULL);
+
+	memset(cells, 0xff, sizeof *cells);
+
+	u8(*inside)[h][w] = calloc(1, sizeof *inside);
+	assert(inside != NULL);
+
+	point *queue = malloc(w * h * sizeof(point));
+	assert(queue != NULL);
+
+	u32 head = 0;
+	u32 tail = 0;
+
+	point start = game->state.positions[0];
+	(*inside)[start.y][start.x] = 1;
+	queue[tail++] = start;
+
+	while (head != tail) {
+		point pos = queue[head++];
+
+		for (u32 dir = LEFT; dir <= DOWN; ++dir) {
+			u32 x = pos.x + dir_dx[dir];
+			u32 y = pos.y + dir_dy[dir];
+
+			if (x >= w || y >= h || (*inside)[y][x])
+				continue;
+
+			if ((*board)[y][x] == WALL || (*board)[y][x] == 0)
+				continue;
+
+			(*inside)[y][x] = 1;
+			queue[tail++] = (point){ x, y };
+		}
+	}
+
+	for (u32 i = 1; i <= game->ngoals; ++i) {
+		point box = game->state.positions[i];
+		(*inside)[box.y][box.x] = 1;
+	}
+
+	u32 ncells = 0;
+
+	for (u32 y = 0; y < h; ++y) {
+		for (u32 x = 0; x < w; ++x) {
+			if ((*inside)[y][x])
+				(*cells)[y][x] = ncells++;
+		}
+	}
+
+	free(inside);
+	free(queue);
+
+	game->cells = (u32 *) cells;
+	game->ncells = ncells;
+	game->cellbytes = (ncells <= 256) ? 1 : 2;
+	game->keysize = sizeof(u64) + game->cellbytes + (ncells + 7) / 8;
+}
+
+static u64 splitmix64(u64 *seed)
+{
+	u64 z = (*seed += 0x9e3779b97f4a7c15);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+/*
+ * Assigns a random key to every inner square for the player and for a box.
+ * The hash of a state is the XOR of the keys of everything on the board, so
+ * a move or a push only has to flip the keys of the squares it changes.
+ */
+static void game_init_zobrist(Game *game)
+{
+	game->zobrist = malloc(2 * game->ncells * sizeof(u64));
+	assert(game->zobrist != NULL);
+
+	u64 seed = 0xdeadbeef;
+
+	for (u32 i = 0; i < 2 * game->ncells; ++i)
+		game->zobrist[i] = splitmix64(&seed);
+
+	game->state.hash = zobrist_player(game, game->state.positions[0]);
+
+	for (u32 i = 1; i <= game->ngoals; ++i)
+		game->state.hash ^= zobrist_box(game, game->state.positions[i]);
+}
+
+void game_parse_board(Game *game, u32 w, u32 h, const char *str)
+{
+	game->width = w;
+	game->height = h;
+
+	game->board = calloc(w * h, 1);
+	assert(game->board);
+
+	game->marks = calloc(w * h, 1);
+	assert(game->marks);
+
+	for (u32 i = 0; str[i]; ++i) {
+		switch (str[i]) {
+		case WALL:
+			game->board[i] = WALL;
+			continue;
+
+		case BOX:
+		case PLAYER:
+		case FLOOR:
+			game->board[i] = FLOOR;
+			continue;
+
+		case BOX_ON_GOAL:
+		case GOAL:
+		case PLAYER_ON_GOAL:
+			game->ngoals++;
+			game->board[i] = GOAL;
+			continue;
+
+		default:
+			continue;
+		}
+	}
+
+	state_init(&game->state, NULL, game->ngoals, NULL);
+	game->goals = calloc(game->ngoals, sizeof(point));
+	assert(game->goals != NULL);
+
+	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
+
+	for (u32 y = 0, i = 0, j = 1, k = 0; y < h; ++y) {
+		for (u32 x = 0; x < w; ++x, ++i) {
+			switch (str[i]) {
+			case GOAL:
+				game->goals[k++] = (point){ x, y };
+				continue;
+
+			case PLAYER_ON_GOAL:
+				game->goals[k++] = (point){ x, y };
+			case PLAYER:
+				game->state.positions[0] = (point){ x, y };
+				continue;
+
+			case BOX_ON_GOAL:
+				game->goals[k++] = (point){ x, y };
+				game->state.on_goals++;
+			case BOX:
+				game->state.positions[j++] = (point){ x, y };
+				continue;
+
+			default:
+				continue;
+			}
+		}
+	}
+
+	live_squares(game->goals, w, h, board, game->ngoals, (u8(*)[h][w]) game->marks);
+
+	game_index_cells(game);
+	game_init_zobrist(game);
+}
+
+/*
+ * Hashes the board the pattern cache was computed for, so that a cache left
+ * over from a different level is never used.
+ */
+static u64 board_hash(Game *game)
+{
+	u64 hash = 0xcbf29ce484222325;
+
+	for (u32 i = 0; i < game->width * game->height; ++i) {
+		hash ^= game->board[i];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+typedef struct {
+	char magic[4];
+	u32 width;
+	u32 height;
+	u64 hash;
+} PatternHeader;
+
+static bool load_patterns(Game *game, const char *cache, PatternHeader *header, usize size)
+{
+	FILE *file = fopen(cache, "rb");
+	if (file == NULL)
+		return FALSE;
+
+	PatternHeader stored;
+	bool ok = fread(&stored, sizeof stored, 1, file) == 1 && memcmp(&stored, header, sizeof stored) == 0 &&
+		fread(game->patterns, size, 1, file) == 1;
+
+	fclose(file);
+	return ok;
+}
+
+static void save_patterns(Game *game, const char *cache, PatternHeader *header, usize size)
+{
+	FILE *file = fopen(cache, "wb");
+	if (file == NULL)
+		return;
+
+	fwrite(header, sizeof *header, 1, file);
+	fwrite(game->patterns, size, 1, file);
+	fclose(file);
+}
+
+/*
+ * Builds the pattern deadlock tables of the level. When a cache file is given,
+ * the tables are read from it if it matches the board, and written to it
+ * otherwise.
+ */
+void game_calc_patterns(Game *game, const char *cache)
+{
+	u32 w = game->width;
+	u32 h = game->height;
+
+	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
+	u8(*marks)[h][w] = (u8(*)[h][w]) game->marks;
+	u64(*patterns)[h][w][8] = malloc(sizeof *patterns);
+	assert(patterns != NULL);
+
+	game->patterns = (u64 *) patterns;
+
+	PatternHeader header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, "DLK1", 4);
+	header.width = w;
+	header.height = h;
+	header.hash = board_hash(game);
+
+	if (cache != NULL && load_patterns(game, cache, &header, sizeof *patterns))
+		return;
+
+	/* Tables cut short by a cancelled game prove less, and aren't worth keeping */
+	if (pattern_deadlocks(game, w, h, board, marks, patterns) && cache != NULL)
+		save_patterns(game, cache, &header, sizeof *patterns);
+}
+
+void game_calc_distances(Game *game, int type)
+{
+	u32 w = game->width;
+	u32 h = game->height;
+
+	u8(*board)[h][w] = (u8(*)[h][w]) game->board;
+	u32(*distances)[game->ngoals][h][w] = malloc(sizeof *distances);
+	assert(distances != NULL);
+
+	switch (type) {
+	case PULL_GOAL_DIST:
+		pull_goal_distance(game->goals, game->state.positions, w, h, board, game->ngoals, distances);
+		break;
+	case MANHATTAN_DIST:
+		manhattan_distance(game->goals, game->state.positions, w, h, board, game->ngoals, distances);
+		break;
+	case PYTHAGOREAN_DIST:
+	default:
+		pythagorean_distance(game->goals, game->state.positions, w, h, board, game->ngoals, distances);
+		break;
+	}
+
+	game->distances = (u32 *) distances;
+}
+
+void game_do_assignment(Game *game, int type)
+{
+	game->assign = type;
+}
+
+/* Monotonic time in nanoseconds, the clock deadlines are set on */
+u64 game_clock(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (u64) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Bytes taken by the states of the level and all of its copies so far */
+usize game_allocated(Game *game)
+{
+	return atomic_load_explicit(&game_root(game)->allocated, memory_order_relaxed);
+}
+
+bool game_out_of_time(Game *game)
+{
+	return game->deadline != 0 && game_clock() >= game->deadline;
+}
+
+/*
+ * The positions of the states and the tables the solvers keep them in count
+ * against the limit. A solver whose tables can't grow any further within the
+ * limit has run out as well. Searches give their memory back when they end,
+ * so running out is remembered for the outcome.
+ */
+bool game_out_of_memory(Game *game)
+{
+	if (atomic_load_explicit(&game->exhausted, memory_order_relaxed))
+		return TRUE;
+
+	if (game->memory_limit == 0 || game_allocated(game) <= game->memory_limit)
+		return FALSE;
+
+	atomic_store_explicit(&game->exhausted, TRUE, memory_order_relaxed);
+
+	return TRUE;
+}
+
+/*
+ * Solvers give up as soon as another thread has asked them or the game they
+ * were copied from to stop, or once they run out of time or memory.
+ */
+bool game_cancelled(Game *game)
+{
+	for (Game *g = game; g != NULL; g = g->parent) {
+		if (g->cancel != NULL && atomic_load_explicit(g->cancel, memory_order_relaxed))
+			return TRUE;
+	}
+
+	return game_out_of_time(game) || game_out_of_memory(game);
+}
+
+/* Names the way a solver finished, telling the limits it hit apart from a level without a solution */
+const char *game_outcome(Game *game, bool solved)
+{
+	if (solved)
+		return "solved";
+	if (game_out_of_time(game))
+		return "timeout";
+	if (game_out_of_memory(game))
+		return "memory";
+
+	return "unsolvable";
 }
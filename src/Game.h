@@ -2,19 +2,25 @@
 #define GAME_H_WUFBIG2D
 
 #include "Definitions.h"
+#include "Stats.h"
 
+#include <stdatomic.h>
 #include <tribble/tribble.h>
 
 typedef struct {
-	TrbString solution;
 	point *positions;
+	u64 hash;
+	u32 parent;
 	u32 total_distance;
 	u32 distance;
+	u32 on_goals;
+	char move;
+	bool closed;
 } State;
 
 void state_destroy(State *state);
 
-typedef struct {
+typedef struct Game {
 	u32 width;
 	u32 height;
 	u32 ngoals;
@@ -23,8 +29,26 @@ typedef struct {
 	u8 *board;
 	u8 *marks;
 
+	u32 *cells;
+	u32 ncells;
+	u32 cellbytes;
+	u32 keysize;
+	u64 *zobrist;
+	u64 *patterns;
+
 	u32 *distances;
-	u32 *assignment;
+	int assign;
+
+	int search;
+	usize memory;
+	u32 threads;
+	_Atomic(bool) *cancel;
+	u64 deadline;
+	usize memory_limit;
+	_Atomic(usize) allocated;
+	_Atomic(bool) exhausted;
+	struct Game *parent;
+	Stats stats;
 
 	State state;
 } Game;
@@ -35,6 +59,11 @@ enum {
 	PYTHAGOREAN_DIST,
 };
 
+enum {
+	MOVE_SEARCH,
+	PUSH_SEARCH,
+};
+
 enum {
 	HUNGARIAN_ASSIGN,
 	GREEDY_ASSIGN,
@@ -42,16 +71,27 @@ enum {
 };
 
 Game *game_init(Game *game);
+Game *game_copy(Game *game, Game *src);
 void game_reset(Game *game);
 void game_destroy(Game *game);
 
 void game_parse_board(Game *game, u32 w, u32 h, const char *str);
+void game_calc_patterns(Game *game, const char *cache);
 
 void game_calc_distances(Game *game, int type);
 void game_do_assignment(Game *game, int type);
+u64 game_clock(void);
+usize game_allocated(Game *game);
+bool game_out_of_time(Game *game);
+bool game_out_of_memory(Game *game);
+bool game_cancelled(Game *game);
+const char *game_outcome(Game *game, bool solved);
 
-bool game_solve_dfs(Game *game, State *ret);
-bool game_solve_astar(Game *game, State *ret);
-bool game_solve_cbfs(Game *game, State *ret);
+bool game_solve_dfs(Game *game, TrbString *ret);
+bool game_solve_astar(Game *game, TrbString *ret);
+bool game_solve_cbfs(Game *game, TrbString *ret);
+bool game_solve_bidir(Game *game, TrbString *ret);
+bool game_solve_idastar(Game *game, TrbString *ret);
+bool game_solve_portfolio(Game *game, TrbString *ret);
 
 #endif /* end of include guard: GAME_H_WUFBIG2D */
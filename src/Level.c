@@ -0,0 +1,365 @@
+#include "Level.h"
+
+#include "Definitions.h"
+#include "Game.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool pack_open(Pack *pack, const char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return FALSE;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return FALSE;
+	}
+
+	pack->data = NULL;
+	pack->size = st.st_size;
+	pack->pos = 0;
+	pack->count = 0;
+	pack->title = NULL;
+
+	if (pack->size != 0) {
+		void *data = mmap(NULL, pack->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data == MAP_FAILED) {
+			close(fd);
+			return FALSE;
+		}
+
+		madvise(data, pack->size, MADV_SEQUENTIAL);
+		pack->data = data;
+	}
+
+	close(fd);
+
+	/* Files of a single level start with its size */
+	usize i = 0;
+	while (i < pack->size && isspace(pack->data[i]))
+		i++;
+
+	pack->sized = i < pack->size && isdigit(pack->data[i]);
+
+	return TRUE;
+}
+
+void pack_close(Pack *pack)
+{
+	if (pack->data != NULL)
+		munmap((void *) pack->data, pack->size);
+
+	free(pack->title);
+}
+
+/* Returns the next line without its line break and trailing blanks */
+static bool pack_line(Pack *pack, const char **line, usize *len)
+{
+	if (pack->pos >= pack->size)
+		return FALSE;
+
+	const char *start = pack->data + pack->pos;
+	const char *end = memchr(start, '\n', pack->size - pack->pos);
+
+	if (end == NULL)
+		end = pack->data + pack->size;
+
+	pack->pos = end - pack->data + 1;
+
+	while (end != start && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+		end--;
+
+	*line = start;
+	*len = end - start;
+
+	return TRUE;
+}
+
+/* Board lines hold nothing but squares, and at least one wall */
+static bool is_board_line(const char *line, usize len)
+{
+	bool wall = FALSE;
+
+	for (usize i = 0; i < len; ++i) {
+		if (strchr("#@+$*.-_ ", line[i]) == NULL)
+			return FALSE;
+
+		if (line[i] == WALL)
+			wall = TRUE;
+	}
+
+	return wall;
+}
+
+/*
+ * Picks the name of a level out of a line that isn't part of a board.
+ * Comments name the level as well, but other fields such as the author
+ * don't. Returns FALSE if there is nothing to take.
+ */
+static bool title_line(const char *line, usize len, const char **title, usize *title_len)
+{
+	if (len >= 6 && strncasecmp(line, "title:", 6) == 0) {
+		line += 6;
+		len -= 6;
+	} else {
+		usize i = 0;
+		while (i < len && isalpha(line[i]))
+			i++;
+
+		if (i != 0 && i < len && line[i] == ':')
+			return FALSE;
+	}
+
+	while (len != 0 && (*line == ';' || *line == ' ' || *line == '\t')) {
+		line++;
+		len--;
+	}
+
+	if (len == 0)
+		return FALSE;
+
+	*title = line;
+	*title_len = len;
+
+	return TRUE;
+}
+
+static void pack_set_title(Pack *pack, const char *title, usize len)
+{
+	free(pack->title);
+	pack->title = NULL;
+
+	if (title == NULL)
+		return;
+
+	pack->title = malloc(len + 1);
+	assert(pack->title != NULL);
+
+	memcpy(pack->title, title, len);
+	pack->title[len] = '\0';
+}
+
+/* A board can only be solved with a single player and as many boxes as goals */
+static bool board_valid(const char *board)
+{
+	u32 players = 0;
+	u32 boxes = 0;
+	u32 goals = 0;
+
+	for (u32 i = 0; board[i]; ++i) {
+		switch (board[i]) {
+		case PLAYER_ON_GOAL:
+			goals++;
+		case PLAYER:
+			players++;
+			break;
+
+		case BOX_ON_GOAL:
+			goals++;
+		case BOX:
+			boxes++;
+			break;
+
+		case GOAL:
+			goals++;
+			break;
+		}
+	}
+
+	return players == 1 && boxes != 0 && boxes == goals;
+}
+
+static u32 pack_number(Pack *pack)
+{
+	while (pack->pos < pack->size && isspace(pack->data[pack->pos]))
+		pack->pos++;
+
+	u32 number = 0;
+	while (pack->pos < pack->size && isdigit(pack->data[pack->pos]))
+		number = number * 10 + pack->data[pack->pos++] - '0';
+
+	return number;
+}
+
+/* Reads the board of a file holding a single level, after its width and height */
+static char *pack_read_sized(Pack *pack, u32 *w, u32 *h)
+{
+	*w = pack_number(pack);
+	*h = pack_number(pack);
+
+	if (*w == 0 || *h == 0)
+		return NULL;
+
+	char *board = malloc(*w * *h + 1);
+	assert(board != NULL);
+
+	for (u32 i = 0; i < *w * *h;) {
+		if (pack->pos >= pack->size) {
+			free(board);
+			return NULL;
+		}
+
+		char c = pack->data[pack->pos++];
+		if (c != '\n' && c != '\r')
+			board[i++] = c;
+	}
+
+	board[*w * *h] = '\0';
+
+	return board;
+}
+
+/*
+ * Reads the next board of a pack. Its name is the title that follows it,
+ * or else the last line before it that isn't a board. A title that follows
+ * a board is read along with it, so it can't name the next one as well.
+ */
+static char *pack_read_board(Pack *pack, u32 *w, u32 *h)
+{
+	const char *line;
+	usize len;
+
+	const char *title = NULL;
+	usize title_len = 0;
+
+	while (TRUE) {
+		if (!pack_line(pack, &line, &len))
+			return NULL;
+
+		if (is_board_line(line, len))
+			break;
+
+		title_line(line, len, &title, &title_len);
+	}
+
+	usize start = line - pack->data;
+	usize end = pack->pos;
+	*w = len;
+	*h = 1;
+
+	while (pack_line(pack, &line, &len) && is_board_line(line, len)) {
+		if (len > *w)
+			*w = len;
+
+		(*h)++;
+		end = pack->pos;
+	}
+
+	/* Looks for a title up to the next board, which is read past if there is one */
+	usize next = end;
+
+	for (pack->pos = end; pack_line(pack, &line, &len) && !is_board_line(line, len);) {
+		if (len >= 6 && strncasecmp(line, "title:", 6) == 0) {
+			title_line(line, len, &title, &title_len);
+			next = pack->pos;
+			break;
+		}
+	}
+
+	pack->pos = start;
+	pack_set_title(pack, title, title_len);
+
+	char *board = malloc(*w * *h + 1);
+	assert(board != NULL);
+
+	/* Short rows are padded, and both kinds of floor marks mean floor */
+	memset(board, FLOOR, *w * *h);
+	board[*w * *h] = '\0';
+
+	for (u32 y = 0; y < *h; ++y) {
+		pack_line(pack, &line, &len);
+
+		for (usize x = 0; x < len; ++x)
+			board[y * *w + x] = line[x] == '-' || line[x] == '_' ? FLOOR : line[x];
+	}
+
+	pack->pos = next;
+
+	return board;
+}
+
+/*
+ * Parses the next level into the game, or only skips it if there is no game.
+ * An invalid level is skipped as well and leaves the game untouched.
+ */
+int pack_next(Pack *pack, Game *game)
+{
+	if (pack->sized && pack->count != 0)
+		return PACK_END;
+
+	u32 w, h;
+	char *board = pack->sized ? pack_read_sized(pack, &w, &h) : pack_read_board(pack, &w, &h);
+
+	if (board == NULL && !pack->sized)
+		return PACK_END;
+
+	pack->count++;
+
+	if (board == NULL)
+		return PACK_INVALID;
+
+	if (!board_valid(board)) {
+		free(board);
+		return PACK_INVALID;
+	}
+
+	if (game != NULL) {
+		game_init(game);
+		game_parse_board(game, w, h, board);
+	}
+
+	free(board);
+
+	return PACK_LEVEL;
+}
+
+/*
+ * Reads the level with the given number, counted from one. Returns FALSE if
+ * there is no such level or it can't be solved, in which case the game is
+ * left untouched.
+ */
+bool level_load(Game *game, const char *filename, u32 index)
+{
+	Pack pack;
+	if (!pack_open(&pack, filename))
+		return FALSE;
+
+	int result = PACK_END;
+	while (pack.count < index) {
+		result = pack_next(&pack, pack.count + 1 == index ? game : NULL);
+
+		if (result == PACK_END)
+			break;
+	}
+
+	pack_close(&pack);
+
+	return result == PACK_LEVEL && pack.count == index;
+}
+
+/* The patterns are cached next to the level, with the number of the level in packs */
+void level_calc_patterns(Game *game, const char *filename, u32 index)
+{
+	char *cache = malloc(strlen(filename) + sizeof ".4294967295.dlk");
+	assert(cache != NULL);
+
+	if (index == 1)
+		sprintf(cache, "%s.dlk", filename);
+	else
+		sprintf(cache, "%s.%u.dlk", filename, index);
+
+	game_calc_patterns(game, cache);
+	free(cache);
+}
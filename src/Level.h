@@ -0,0 +1,36 @@
+#ifndef LEVEL_H_Q2M8TXWD
+#define LEVEL_H_Q2M8TXWD
+
+#include "Definitions.h"
+#include "Game.h"
+
+/*
+ * Reader of the levels in a file. The file is mapped into memory and levels
+ * are parsed one at a time as they are asked for, so packs of any size can
+ * be read. A file either holds a single level behind its width and height,
+ * or is a pack in the usual text format, where the levels are separated by
+ * lines that aren't part of a board, such as titles and comments.
+ */
+typedef struct {
+	const char *data;
+	usize size;
+	usize pos;
+	bool sized;
+	u32 count;
+	char *title;
+} Pack;
+
+enum {
+	PACK_END,
+	PACK_LEVEL,
+	PACK_INVALID,
+};
+
+bool pack_open(Pack *pack, const char *filename);
+int pack_next(Pack *pack, Game *game);
+void pack_close(Pack *pack);
+
+bool level_load(Game *game, const char *filename, u32 index);
+void level_calc_patterns(Game *game, const char *filename, u32 index);
+
+#endif /* end of include guard: LEVEL_H_Q2M8TXWD */
@@ -0,0 +1,941 @@
+#include "Game.h"
+
+#include "Definitions.h"
+#include "Pool.h"
+#include "Search.h"
+#include "Set.h"
+
+#include <assert.h>
+#include <memory.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define BATCH_STATES 64
+#define FLUSH_INTERVAL 64
+
+/*
+ * Intrusive multi-producer single-consumer queue. Producers only swap the
+ * head, so pushing never blocks; the consumer walks from the tail and may
+ * briefly see an empty queue while a push is half-way done.
+ */
+typedef struct QueueNode {
+	_Atomic(struct QueueNode *) next;
+} QueueNode;
+
+typedef struct {
+	_Atomic(QueueNode *) head;
+	QueueNode *tail;
+	QueueNode stub;
+} Queue;
+
+/*
+ * States generated for one worker. Every record holds the state, the worker
+ * owning its parent, the key of the state and a copy of its pool object.
+ */
+typedef struct {
+	QueueNode node;
+	usize len;
+	u8 data[];
+} Batch;
+
+typedef struct {
+	State state;
+	u32 parent_worker;
+} Record;
+
+/*
+ * The nodes stored by one thread. A parent may be stored by another thread,
+ * so every node also records which one. The initial state is node 0 of every
+ * shard, so parent links of any shard end in the same place.
+ */
+typedef struct {
+	Search search;
+	TrbVector owners;
+} Shard;
+
+typedef struct Parallel Parallel;
+
+/*
+ * A worker owns the states whose hash maps to it: only the owner stores,
+ * deduplicates and expands them.
+ */
+typedef struct {
+	Shard shard;
+	Parallel *parallel;
+	u32 id;
+	TrbHashTable seen;
+	TrbHeap open;
+	Queue queue;
+	Batch **outgoing;
+	pthread_t thread;
+} Worker;
+
+/*
+ * The work counter holds the number of states in the open lists and in the
+ * batches, sent or not. It only drops to zero once every worker has run dry
+ * and nothing is on the way, and then the incumbent solution is optimal.
+ */
+struct Parallel {
+	Game *game;
+	Worker *workers;
+	u32 nworkers;
+	usize record_size;
+	usize object_size;
+
+	_Atomic i64 work;
+	_Atomic u32 incumbent;
+	_Atomic bool done;
+
+	pthread_mutex_t lock;
+	u32 goal_worker;
+	u32 goal_node;
+};
+
+static void shard_init(Shard *shard, Game *game)
+{
+	search_init(&shard->search, game);
+	trb_vector_init(&shard->owners, FALSE, sizeof(u32));
+	trb_vector_push_back(&shard->owners, trb_get_ptr(u32, 0));
+}
+
+static void shard_destroy(Shard *shard)
+{
+	trb_vector_destroy(&shard->owners, NULL);
+	search_destroy(&shard->search);
+}
+
+/* Stores a new node and returns its index */
+static u32 shard_add(Shard *shard, State *state, u32 parent_shard)
+{
+	u32 index = shard->search.nodes.len;
+	trb_vector_push_back(&shard->search.nodes, state);
+	trb_vector_push_back(&shard->owners, &parent_shard);
+
+	return index;
+}
+
+/*
+ * Rebuilds the solution by following the parent links across the shards,
+ * copying the path into the node store of the first one.
+ */
+static void shard_solution(Shard **shards, u32 goal_shard, u32 goal_node, TrbString *ret)
+{
+	Search *search = &shards[0]->search;
+
+	u32 depth = 0;
+	for (u32 s = goal_shard, i = goal_node;; ++depth) {
+		State *state = trb_vector_ptr(&shards[s]->search.nodes, State, i);
+
+		if (state->parent == U32_MAX)
+			break;
+
+		s = trb_vector_get(&shards[s]->owners, u32, i);
+		i = state->parent;
+	}
+
+	State *chain = malloc(depth * sizeof(State));
+	assert(chain != NULL);
+
+	for (u32 s = goal_shard, i = goal_node, j = depth; j != 0;) {
+		chain[--j] = trb_vector_get(&shards[s]->search.nodes, State, i);
+
+		s = trb_vector_get(&shards[s]->owners, u32, i);
+		i = chain[j].parent;
+	}
+
+	u32 parent = 0;
+	for (u32 i = 0; i < depth; ++i) {
+		chain[i].parent = parent;
+		parent = search->nodes.len;
+		trb_vector_push_back(&search->nodes, &chain[i]);
+	}
+
+	game_solution(search, parent, ret);
+	free(chain);
+}
+
+static void queue_init(Queue *queue)
+{
+	atomic_init(&queue->stub.next, NULL);
+	atomic_init(&queue->head, &queue->stub);
+	queue->tail = &queue->stub;
+}
+
+static void queue_push(Queue *queue, QueueNode *node)
+{
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	QueueNode *prev = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+	atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+static QueueNode *queue_pop(Queue *queue)
+{
+	QueueNode *tail = queue->tail;
+	QueueNode *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	if (tail == &queue->stub) {
+		if (next == NULL)
+			return NULL;
+
+		queue->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&next->next, memory_order_acquire);
+	}
+
+	if (next != NULL) {
+		queue->tail = next;
+		return tail;
+	}
+
+	if (tail != atomic_load_explicit(&queue->head, memory_order_acquire))
+		return NULL;
+
+	queue_push(queue, &queue->stub);
+
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (next != NULL) {
+		queue->tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+static u32 state_owner(Parallel *parallel, const u8 *key)
+{
+	u64 hash;
+	memcpy(&hash, key, sizeof hash);
+
+	return (hash >> 32) % parallel->nworkers;
+}
+
+static Record *batch_record(Parallel *parallel, Batch *batch, u32 i)
+{
+	return (Record *) (batch->data + i * parallel->record_size);
+}
+
+static void worker_flush(Worker *worker, u32 target)
+{
+	Batch *batch = worker->outgoing[target];
+	if (batch == NULL || batch->len == 0)
+		return;
+
+	queue_push(&worker->parallel->workers[target].queue, &batch->node);
+	worker->outgoing[target] = NULL;
+}
+
+static void worker_flush_all(Worker *worker)
+{
+	for (u32 i = 0; i < worker->parallel->nworkers; ++i) {
+		if (i != worker->id)
+			worker_flush(worker, i);
+	}
+}
+
+/* Appends a generated state to the batch of its owner, returns the owner */
+static u32 worker_send(Worker *worker, State *state, u32 parent_worker, const u8 *key)
+{
+	Parallel *parallel = worker->parallel;
+	u32 target = state_owner(parallel, key);
+
+	Batch *batch = worker->outgoing[target];
+	if (batch == NULL) {
+		batch = malloc(sizeof(Batch) + BATCH_STATES * parallel->record_size);
+		assert(batch != NULL);
+
+		batch->len = 0;
+		worker->outgoing[target] = batch;
+	}
+
+	Record *record = batch_record(parallel, batch, batch->len++);
+	record->state = *state;
+	record->parent_worker = parent_worker;
+
+	u8 *data = (u8 *) (record + 1);
+	memcpy(data, key, parallel->game->keysize);
+	memcpy(data + parallel->game->keysize, state->positions, parallel->object_size);
+
+	return target;
+}
+
+static void worker_goal(Worker *worker, u32 node, u32 distance)
+{
+	Parallel *parallel = worker->parallel;
+
+	pthread_mutex_lock(&parallel->lock);
+
+	if (distance < atomic_load(&parallel->incumbent)) {
+		atomic_store(&parallel->incumbent, distance);
+		parallel->goal_worker = worker->id;
+		parallel->goal_node = node;
+	}
+
+	pthread_mutex_unlock(&parallel->lock);
+}
+
+/*
+ * Takes over the states of a batch. States already stored with a shorter
+ * path are dropped, the others become new nodes or replace their old ones,
+ * which are then opened again.
+ */
+static void worker_receive(Worker *worker, Batch *batch)
+{
+	Parallel *parallel = worker->parallel;
+	Search *search = &worker->shard.search;
+	u32 keysize = parallel->game->keysize;
+	i64 dropped = 0;
+
+	for (u32 i = 0; i < batch->len; ++i) {
+		Record *record = batch_record(parallel, batch, i);
+		State *next = &record->state;
+		u8 *key = (u8 *) (record + 1);
+		u8 *object = key + keysize;
+
+		u32 index;
+		if (trb_hash_table_lookup(&worker->seen, key, &index)) {
+			State *old = trb_vector_ptr(&search->nodes, State, index);
+
+			if (next->distance >= old->distance) {
+				search->stats.duplicates++;
+				dropped++;
+				continue;
+			}
+
+			memcpy(old->positions, object, parallel->object_size);
+			old->hash = next->hash;
+			old->parent = next->parent;
+			old->move = next->move;
+			old->distance = next->distance;
+			old->total_distance = next->total_distance;
+			old->closed = FALSE;
+
+			*trb_vector_ptr(&worker->shard.owners, u32, index) = record->parent_worker;
+		} else {
+			next->positions = pool_alloc(&search->pool);
+			memcpy(next->positions, object, parallel->object_size);
+			next->closed = FALSE;
+
+			index = shard_add(&worker->shard, next, record->parent_worker);
+			trb_hash_table_insert(&worker->seen, key, &index);
+		}
+
+		if (is_solved(parallel->game, next)) {
+			worker_goal(worker, index, next->distance);
+			dropped++;
+			continue;
+		}
+
+		trb_heap_insert(&worker->open, &(OpenEntry){ next->total_distance, next->distance, index });
+		stats_peak(&search->stats.peak_open, worker->open.vector.len);
+	}
+
+	search_charge(search, search->nodes.len, worker->open.vector.len * sizeof(OpenEntry) + worker->shard.owners.len * sizeof(u32));
+	batch->len = 0;
+
+	if (dropped != 0)
+		atomic_fetch_sub(&parallel->work, dropped);
+}
+
+static void worker_expand(Worker *worker, u32 node)
+{
+	Parallel *parallel = worker->parallel;
+	Search *search = &worker->shard.search;
+	State succs[4 * parallel->game->ngoals + 4];
+
+	State *vertex_node = trb_vector_ptr(&search->nodes, State, node);
+	vertex_node->closed = TRUE;
+
+	State vertex = *vertex_node;
+	u32 nsuccs = game_successors(search, &vertex, succs);
+	u32 incumbent = atomic_load_explicit(&parallel->incumbent, memory_order_relaxed);
+	i64 sent = 0;
+
+	for (u32 i = 0; i < nsuccs; ++i) {
+		State *next = &succs[i];
+		u8 *key = game_key(search, next);
+
+		next->parent = node;
+		next->distance = vertex.distance + 1;
+
+		u32 estimate = is_solved(parallel->game, next) ? 0 : game_heuristic(search, &vertex, next);
+
+		if (estimate != U32_MAX && next->distance + estimate < incumbent) {
+			next->total_distance = next->distance + estimate;
+
+			u32 target = worker_send(worker, next, worker->id, key);
+			sent++;
+
+			if (worker->outgoing[target]->len == BATCH_STATES) {
+				/* Counted before the batch becomes visible to the owner */
+				atomic_fetch_add(&parallel->work, sent);
+				sent = 0;
+
+				if (target == worker->id)
+					worker_receive(worker, worker->outgoing[target]);
+				else
+					worker_flush(worker, target);
+			}
+		}
+
+		pool_free(&search->pool, next->positions);
+	}
+
+	atomic_fetch_add(&parallel->work, sent - 1);
+
+	Batch *own = worker->outgoing[worker->id];
+	if (own != NULL && own->len != 0)
+		worker_receive(worker, own);
+}
+
+static void *worker_run(void *data)
+{
+	Worker *worker = data;
+	Parallel *parallel = worker->parallel;
+	u32 expanded = 0;
+
+	while (!atomic_load_explicit(&parallel->done, memory_order_relaxed)) {
+		if (game_cancelled(parallel->game)) {
+			atomic_store(&parallel->done, TRUE);
+			break;
+		}
+
+		QueueNode *node;
+		while ((node = queue_pop(&worker->queue)) != NULL) {
+			Batch *batch = (Batch *) node;
+			worker_receive(worker, batch);
+			free(batch);
+		}
+
+		if (worker->open.vector.len == 0) {
+			worker_flush_all(worker);
+
+			if (atomic_load(&parallel->work) == 0)
+				atomic_store(&parallel->done, TRUE);
+			else
+				sched_yield();
+
+			continue;
+		}
+
+		OpenEntry entry;
+		trb_heap_pop_front(&worker->open, &entry);
+
+		State *vertex = trb_vector_ptr(&worker->shard.search.nodes, State, entry.node);
+		u32 incumbent = atomic_load_explicit(&parallel->incumbent, memory_order_relaxed);
+
+		if (vertex->closed || entry.total_distance != vertex->total_distance || entry.total_distance >= incumbent) {
+			atomic_fetch_sub(&parallel->work, 1);
+			continue;
+		}
+
+		worker_expand(worker, entry.node);
+
+		/* Lets the owners catch up when there are more workers than cores */
+		if (++expanded % FLUSH_INTERVAL == 0) {
+			worker_flush_all(worker);
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * A* spread over threads. Every worker owns the states whose hash maps to it
+ * and keeps their open list and table; generated states are sent to their
+ * owners in batches through lock-free queues. A solution found is kept as an
+ * incumbent until no open state can lead to a shorter one.
+ */
+bool parallel_astar(Game *game, TrbString *ret)
+{
+	Parallel parallel;
+	parallel.game = game;
+	parallel.nworkers = game->threads;
+
+	parallel.workers = malloc(parallel.nworkers * sizeof(Worker));
+	assert(parallel.workers != NULL);
+
+	for (u32 i = 0; i < parallel.nworkers; ++i) {
+		Worker *worker = &parallel.workers[i];
+		worker->parallel = &parallel;
+		worker->id = i;
+
+		shard_init(&worker->shard, game);
+		trb_hash_table_init_data(&worker->seen, game->keysize, sizeof(u32), 0xdeadbeef, key_hash, (TrbCmpDataFunc) key_cmp, &game->keysize);
+		trb_heap_init(&worker->open, sizeof(OpenEntry), (TrbCmpFunc) open_pcmp);
+		queue_init(&worker->queue);
+
+		worker->outgoing = calloc(parallel.nworkers, sizeof(Batch *));
+		assert(worker->outgoing != NULL);
+	}
+
+	parallel.object_size = parallel.workers[0].shard.search.pool.size;
+	parallel.record_size = (sizeof(Record) + game->keysize + parallel.object_size + 7) & ~(usize) 7;
+
+	atomic_init(&parallel.work, 1);
+	atomic_init(&parallel.incumbent, U32_MAX);
+	atomic_init(&parallel.done, FALSE);
+	pthread_mutex_init(&parallel.lock, NULL);
+
+	Worker *root = &parallel.workers[0];
+	State *init_state = trb_vector_ptr(&root->shard.search.nodes, State, 0);
+	u8 *key = game_key(&root->shard.search, init_state);
+	root = &parallel.workers[state_owner(&parallel, key)];
+	init_state = trb_vector_ptr(&root->shard.search.nodes, State, 0);
+
+	bool found = FALSE;
+	init_state->total_distance = game_heuristic(&root->shard.search, NULL, init_state);
+
+	if (init_state->total_distance != U32_MAX) {
+		trb_hash_table_insert(&root->seen, game_key(&root->shard.search, init_state), trb_get_ptr(u32, 0));
+		trb_heap_insert(&root->open, &(OpenEntry){ init_state->total_distance, 0, 0 });
+
+		for (u32 i = 0; i < parallel.nworkers; ++i)
+			pthread_create(&parallel.workers[i].thread, NULL, worker_run, &parallel.workers[i]);
+
+		for (u32 i = 0; i < parallel.nworkers; ++i)
+			pthread_join(parallel.workers[i].thread, NULL);
+
+		found = atomic_load(&parallel.incumbent) != U32_MAX;
+
+		if (found) {
+			Shard *shards[parallel.nworkers];
+			for (u32 i = 0; i < parallel.nworkers; ++i)
+				shards[i] = &parallel.workers[i].shard;
+
+			shard_solution(shards, parallel.goal_worker, parallel.goal_node, ret);
+		}
+	}
+
+	pthread_mutex_destroy(&parallel.lock);
+
+	for (u32 i = 0; i < parallel.nworkers; ++i) {
+		Worker *worker = &parallel.workers[i];
+
+		/* A cancelled search leaves batches behind */
+		QueueNode *node;
+		while ((node = queue_pop(&worker->queue)) != NULL)
+			free(node);
+
+		for (u32 j = 0; j < parallel.nworkers; ++j)
+			free(worker->outgoing[j]);
+
+		free(worker->outgoing);
+		trb_heap_destroy(&worker->open, NULL);
+		trb_hash_table_destroy(&worker->seen, NULL, NULL);
+		shard_destroy(&worker->shard);
+	}
+
+	free(parallel.workers);
+
+	return found;
+}
+
+#define STEAL_CHUNK 16
+
+typedef struct {
+	State state;
+	u32 shard;
+	u32 node;
+} FrontierEntry;
+
+typedef struct Layers Layers;
+
+/*
+ * A thread of the breadth-first search. The range is the part of the current
+ * frontier it still has to expand, packed as begin and end into one word so
+ * that the owner and thieves can both shrink it with a compare-and-swap.
+ */
+typedef struct {
+	Shard shard;
+	Layers *layers;
+	u32 id;
+	_Atomic u64 range;
+	TrbVector generated;
+	TrbVector overflow;
+	usize added;
+	usize offset;
+	pthread_t thread;
+} Expander;
+
+/*
+ * The frontier of the current depth and the one being built are kept in two
+ * buffers that swap roles after every layer. States that found no room in
+ * the visited set wait in the overflow of their thread until the set has
+ * grown at the end of the layer.
+ */
+struct Layers {
+	Game *game;
+	Expander *expanders;
+	u32 nexpanders;
+	Set visited;
+	usize nvisited;
+	pthread_barrier_t barrier;
+
+	FrontierEntry *frontier[2];
+	usize capacity[2];
+	usize len;
+
+	_Atomic u32 goal_shard;
+	u32 goal_node;
+	bool done;
+};
+
+static u64 range_pack(u32 begin, u32 end)
+{
+	return (u64) begin << 32 | end;
+}
+
+/* Takes a chunk from the front of the range of the expander itself */
+static bool range_take(Expander *expander, u32 *begin, u32 *end)
+{
+	u64 range = atomic_load(&expander->range);
+
+	while (TRUE) {
+		u32 b = range >> 32;
+		u32 e = range;
+
+		if (b >= e)
+			return FALSE;
+
+		u32 next = e - b > STEAL_CHUNK ? b + STEAL_CHUNK : e;
+
+		if (atomic_compare_exchange_weak(&expander->range, &range, range_pack(next, e))) {
+			*begin = b;
+			*end = next;
+			return TRUE;
+		}
+	}
+}
+
+/* Moves the back half of the range of the victim to the thief */
+static bool range_steal(Expander *thief, Expander *victim)
+{
+	u64 range = atomic_load(&victim->range);
+
+	while (TRUE) {
+		u32 b = range >> 32;
+		u32 e = range;
+
+		if (b >= e)
+			return FALSE;
+
+		u32 mid = b + (e - b) / 2;
+
+		if (atomic_compare_exchange_weak(&victim->range, &range, range_pack(b, mid))) {
+			atomic_store(&thief->range, range_pack(mid, e));
+			return TRUE;
+		}
+	}
+}
+
+/* Stores a state new to the set as a node of the expander and puts it on the next frontier */
+static void expander_add(Expander *expander, State *next, u32 parent_shard)
+{
+	Layers *layers = expander->layers;
+
+	u32 index = shard_add(&expander->shard, next, parent_shard);
+	trb_vector_push_back(&expander->generated, &(FrontierEntry){ *next, expander->id, index });
+	expander->added++;
+
+	if (is_solved(layers->game, next)) {
+		u32 none = U32_MAX;
+
+		if (atomic_compare_exchange_strong(&layers->goal_shard, &none, expander->id))
+			layers->goal_node = index;
+	}
+}
+
+static void expander_expand(Expander *expander, FrontierEntry *entry)
+{
+	Layers *layers = expander->layers;
+	Search *search = &expander->shard.search;
+	State succs[4 * layers->game->ngoals + 4];
+
+	u32 nsuccs = game_successors(search, &entry->state, succs);
+
+	for (u32 i = 0; i < nsuccs; ++i) {
+		State *next = &succs[i];
+		int result = set_insert(&layers->visited, game_key(search, next));
+
+		if (result == SET_PRESENT) {
+			search->stats.duplicates++;
+			pool_free(&search->pool, next->positions);
+			continue;
+		}
+
+		next->parent = entry->node;
+		next->distance = entry->state.distance + 1;
+
+		/* Until the state is stored, its entry holds the shard of its parent */
+		if (result == SET_FULL)
+			trb_vector_push_back(&expander->overflow, &(FrontierEntry){ *next, entry->shard, U32_MAX });
+		else
+			expander_add(expander, next, entry->shard);
+	}
+}
+
+static bool layers_stopped(Layers *layers)
+{
+	return atomic_load_explicit(&layers->goal_shard, memory_order_relaxed) != U32_MAX || game_cancelled(layers->game);
+}
+
+/*
+ * Charges the visited set and the frontiers to the first thread, and what
+ * every thread keeps to itself to that thread.
+ */
+static void layers_charge(Layers *layers)
+{
+	for (u32 i = 0; i < layers->nexpanders; ++i) {
+		Expander *expander = &layers->expanders[i];
+		usize bytes = (expander->generated.len + expander->overflow.len) * sizeof(FrontierEntry) + expander->shard.owners.len * sizeof(u32);
+
+		if (i == 0)
+			bytes += layers->visited.capacity * layers->visited.stride + (layers->capacity[0] + layers->capacity[1]) * sizeof(FrontierEntry);
+
+		search_charge(&expander->shard.search, 0, bytes);
+	}
+}
+
+/*
+ * Doubles the visited set, unless the larger set and the states wouldn't fit
+ * within the memory limit together.
+ */
+static bool layers_grow(Layers *layers)
+{
+	Game *game = layers->game;
+	usize bytes = 2 * layers->visited.capacity * layers->visited.stride;
+
+	if (game->memory_limit != 0 && game_allocated(game) + bytes > game->memory_limit)
+		return FALSE;
+
+	set_grow(&layers->visited);
+	layers_charge(layers);
+
+	return TRUE;
+}
+
+/*
+ * Keeps the set at most half full for the next layer, and stores the states
+ * that didn't fit during this one. If the set can't grow any more, the search
+ * has run out of memory.
+ */
+static void layers_overflow(Layers *layers)
+{
+	usize pending = 0;
+
+	for (u32 i = 0; i < layers->nexpanders; ++i) {
+		layers->nvisited += layers->expanders[i].added;
+		layers->expanders[i].added = 0;
+		pending += layers->expanders[i].overflow.len;
+	}
+
+	while ((layers->nvisited + pending) * 2 > layers->visited.capacity) {
+		if (!layers_grow(layers)) {
+			if (pending != 0)
+				atomic_store(&layers->game->exhausted, TRUE);
+
+			break;
+		}
+	}
+
+	for (u32 i = 0; i < layers->nexpanders; ++i) {
+		Expander *expander = &layers->expanders[i];
+		Search *search = &expander->shard.search;
+
+		for (usize j = 0; j < expander->overflow.len; ++j) {
+			FrontierEntry *entry = trb_vector_ptr(&expander->overflow, FrontierEntry, j);
+			int result = SET_FULL;
+
+			if (!atomic_load(&layers->game->exhausted)) {
+				result = set_insert(&layers->visited, game_key(search, &entry->state));
+
+				while (result == SET_FULL && layers_grow(layers))
+					result = set_insert(&layers->visited, game_key(search, &entry->state));
+
+				if (result == SET_FULL)
+					atomic_store(&layers->game->exhausted, TRUE);
+			}
+
+			if (result == SET_ADDED) {
+				expander_add(expander, &entry->state, entry->shard);
+				continue;
+			}
+
+			if (result == SET_PRESENT)
+				search->stats.duplicates++;
+
+			pool_free(&search->pool, entry->state.positions);
+		}
+
+		expander->overflow.len = 0;
+	}
+}
+
+/*
+ * Builds the next frontier from the states every thread generated. The set
+ * has already dropped the duplicates, so the parts are only placed one after
+ * another, and each thread copies its own part.
+ */
+static void layers_merge(Layers *layers, u32 depth)
+{
+	FrontierEntry **next = &layers->frontier[(depth + 1) & 1];
+	usize *capacity = &layers->capacity[(depth + 1) & 1];
+
+	layers_overflow(layers);
+
+	usize len = 0;
+	for (u32 i = 0; i < layers->nexpanders; ++i) {
+		layers->expanders[i].offset = len;
+		len += layers->expanders[i].generated.len;
+	}
+
+	if (len > *capacity) {
+		*capacity = len;
+		*next = realloc(*next, len * sizeof(FrontierEntry));
+		assert(*next != NULL);
+	}
+
+	layers_charge(layers);
+
+	/* The frontier is shared, so it is only counted by the first thread */
+	stats_peak(&layers->expanders[0].shard.search.stats.peak_open, len);
+
+	layers->len = len;
+	layers->done = len == 0 || layers_stopped(layers);
+}
+
+static void *expander_run(void *data)
+{
+	Expander *expander = data;
+	Layers *layers = expander->layers;
+
+	for (u32 depth = 0;; ++depth) {
+		FrontierEntry *frontier = layers->frontier[depth & 1];
+
+		for (u32 victim = 0; victim < layers->nexpanders && !layers_stopped(layers);) {
+			u32 begin, end;
+
+			if (range_take(expander, &begin, &end)) {
+				for (u32 i = begin; i < end; ++i)
+					expander_expand(expander, &frontier[i]);
+
+				victim = 0;
+				continue;
+			}
+
+			Expander *other = &layers->expanders[(expander->id + victim) % layers->nexpanders];
+			if (other == expander || !range_steal(expander, other))
+				++victim;
+		}
+
+		if (pthread_barrier_wait(&layers->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+			layers_merge(layers, depth);
+
+		pthread_barrier_wait(&layers->barrier);
+
+		if (layers->done)
+			break;
+
+		FrontierEntry *next = layers->frontier[(depth + 1) & 1];
+		usize len = expander->generated.len;
+
+		if (len != 0)
+			memcpy(next + expander->offset, trb_vector_ptr(&expander->generated, FrontierEntry, 0), len * sizeof(FrontierEntry));
+
+		expander->generated.len = 0;
+		atomic_store(&expander->range, range_pack(expander->offset, expander->offset + len));
+
+		pthread_barrier_wait(&layers->barrier);
+	}
+
+	return NULL;
+}
+
+/*
+ * Breadth-first search expanding one depth at a time on all threads. Every
+ * thread starts a layer with the states it generated itself and steals from
+ * the others once it runs out. The visited set is shared and grows between
+ * layers; once the memory limit stops it from growing, the search gives up.
+ */
+bool parallel_bfs(Game *game, TrbString *ret)
+{
+	Layers layers;
+	layers.game = game;
+	layers.nexpanders = game->threads;
+
+	layers.expanders = malloc(layers.nexpanders * sizeof(Expander));
+	assert(layers.expanders != NULL);
+
+	for (u32 i = 0; i < layers.nexpanders; ++i) {
+		Expander *expander = &layers.expanders[i];
+		expander->layers = &layers;
+		expander->id = i;
+
+		shard_init(&expander->shard, game);
+		trb_vector_init(&expander->generated, FALSE, sizeof(FrontierEntry));
+		trb_vector_init(&expander->overflow, FALSE, sizeof(FrontierEntry));
+		expander->added = 0;
+		atomic_init(&expander->range, range_pack(0, i == 0));
+	}
+
+	/* The set grows as needed, so it starts out well within the memory limit */
+	usize memory = game->memory;
+	if (game->memory_limit != 0 && memory > game->memory_limit / 4)
+		memory = game->memory_limit / 4;
+
+	set_init(&layers.visited, game->keysize, memory);
+	pthread_barrier_init(&layers.barrier, NULL, layers.nexpanders);
+
+	Search *search = &layers.expanders[0].shard.search;
+	State *init_state = trb_vector_ptr(&search->nodes, State, 0);
+	set_insert(&layers.visited, game_key(search, init_state));
+	layers.nvisited = 1;
+
+	layers.frontier[0] = malloc(sizeof(FrontierEntry));
+	assert(layers.frontier[0] != NULL);
+
+	layers.frontier[0][0] = (FrontierEntry){ *init_state, 0, 0 };
+	layers.capacity[0] = 1;
+	layers.frontier[1] = NULL;
+	layers.capacity[1] = 0;
+	layers.len = 1;
+
+	atomic_init(&layers.goal_shard, U32_MAX);
+	layers.done = FALSE;
+	layers_charge(&layers);
+
+	for (u32 i = 0; i < layers.nexpanders; ++i)
+		pthread_create(&layers.expanders[i].thread, NULL, expander_run, &layers.expanders[i]);
+
+	for (u32 i = 0; i < layers.nexpanders; ++i)
+		pthread_join(layers.expanders[i].thread, NULL);
+
+	u32 goal_shard = atomic_load(&layers.goal_shard);
+	bool found = goal_shard != U32_MAX;
+
+	if (found) {
+		Shard *shards[layers.nexpanders];
+		for (u32 i = 0; i < layers.nexpanders; ++i)
+			shards[i] = &layers.expanders[i].shard;
+
+		shard_solution(shards, goal_shard, layers.goal_node, ret);
+	}
+
+	pthread_barrier_destroy(&layers.barrier);
+	set_destroy(&layers.visited);
+	free(layers.frontier[0]);
+	free(layers.frontier[1]);
+
+	for (u32 i = 0; i < layers.nexpanders; ++i) {
+		trb_vector_destroy(&layers.expanders[i].generated, NULL);
+		trb_vector_destroy(&layers.expanders[i].overflow, NULL);
+		shard_destroy(&layers.expanders[i].shard);
+	}
+
+	free(layers.expanders);
+
+	return found;
+}
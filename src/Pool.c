@@ -0,0 +1,88 @@
+#include "Pool.h"
+
+#include "Definitions.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define POOL_BLOCK_SIZE (64 * 1024)
+
+Pool *pool_init(Pool *pool, usize size)
+{
+	/* Freed objects are linked through their first word */
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	pool->size = size;
+	pool->block_objects = POOL_BLOCK_SIZE / size;
+	pool->blocks = NULL;
+	pool->free_list = NULL;
+	pool->next = NULL;
+	pool->end = NULL;
+	pool->allocated = 0;
+	pool->usage = NULL;
+
+	if (pool->block_objects < 16)
+		pool->block_objects = 16;
+
+	return pool;
+}
+
+void *pool_alloc(Pool *pool)
+{
+	if (pool->free_list != NULL) {
+		void *ptr = pool->free_list;
+		pool->free_list = *(void **) ptr;
+		return ptr;
+	}
+
+	if (pool->next == pool->end) {
+		usize header = sizeof(void *);
+		usize bytes = header + pool->block_objects * pool->size;
+
+		void **block = malloc(bytes);
+		assert(block != NULL);
+
+		*block = pool->blocks;
+		pool->blocks = block;
+		pool->next = (u8 *) block + header;
+		pool->end = (u8 *) block + bytes;
+		pool->allocated += bytes;
+
+		if (pool->usage != NULL)
+			atomic_fetch_add_explicit(pool->usage, bytes, memory_order_relaxed);
+	}
+
+	void *ptr = pool->next;
+	pool->next += pool->size;
+
+	return ptr;
+}
+
+void pool_free(Pool *pool, void *ptr)
+{
+	*(void **) ptr = pool->free_list;
+	pool->free_list = ptr;
+}
+
+void pool_destroy(Pool *pool)
+{
+	void *block = pool->blocks;
+
+	if (pool->usage != NULL)
+		atomic_fetch_sub_explicit(pool->usage, pool->allocated, memory_order_relaxed);
+
+	while (block != NULL) {
+		void *next = *(void **) block;
+		free(block);
+		block = next;
+	}
+
+	pool->blocks = NULL;
+	pool->free_list = NULL;
+	pool->next = NULL;
+	pool->end = NULL;
+	pool->allocated = 0;
+}
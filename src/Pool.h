@@ -0,0 +1,31 @@
+#ifndef POOL_H_QJ3VNW5R
+#define POOL_H_QJ3VNW5R
+
+#include "Definitions.h"
+
+#include <stdatomic.h>
+
+/*
+ * Allocator of fixed-size objects. Objects are carved out of large blocks,
+ * freed objects are reused by later allocations, and all blocks are released
+ * at once when the pool is destroyed. The size of every new block is also
+ * added to the usage counter, if there is one, and taken off again when the
+ * pool is destroyed.
+ */
+typedef struct {
+	usize size;
+	usize block_objects;
+	void *blocks;
+	void *free_list;
+	u8 *next;
+	u8 *end;
+	usize allocated;
+	_Atomic(usize) *usage;
+} Pool;
+
+Pool *pool_init(Pool *pool, usize size);
+void *pool_alloc(Pool *pool);
+void pool_free(Pool *pool, void *ptr);
+void pool_destroy(Pool *pool);
+
+#endif /* end of include guard: POOL_H_QJ3VNW5R */
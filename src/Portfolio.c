@@ -0,0 +1,146 @@
+#include "Game.h"
+
+#include "Definitions.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A combination of settings raced against the others. Solvers that don't
+ * estimate the remaining pushes have no distance metric, and the bidirectional
+ * search picks its own search mode as well.
+ */
+typedef struct {
+	bool (*solver)(Game *game, TrbString *ret);
+	int distance;
+	int assign;
+	int search;
+} Config;
+
+static const Config configs[] = {
+	{ game_solve_astar,   PULL_GOAL_DIST, HUNGARIAN_ASSIGN, PUSH_SEARCH },
+	{ game_solve_cbfs,    MANHATTAN_DIST, GREEDY_ASSIGN,    PUSH_SEARCH },
+	{ game_solve_idastar, PULL_GOAL_DIST, HUNGARIAN_ASSIGN, PUSH_SEARCH },
+	{ .solver = game_solve_bidir, .distance = -1 },
+};
+
+#define NCONFIGS (sizeof configs / sizeof *configs)
+
+typedef struct {
+	Game game;
+	const Config *config;
+	TrbString solution;
+	bool solved;
+	_Atomic u32 *winner;
+	u32 id;
+	pthread_t thread;
+} Racer;
+
+/*
+ * Gives the racer the distances of its metric, computed only by the first
+ * racer that uses the metric and copied by the others.
+ */
+static void racer_distances(Racer *racers, u32 id)
+{
+	Game *game = &racers[id].game;
+	const Config *config = racers[id].config;
+
+	if (config->distance == -1)
+		return;
+
+	free(game->distances);
+	game->distances = NULL;
+
+	for (u32 i = 0; i < id && game->distances == NULL; ++i) {
+		if (racers[i].config->distance == config->distance) {
+			usize size = game->ngoals * game->width * game->height * sizeof(u32);
+
+			game->distances = malloc(size);
+			assert(game->distances != NULL);
+
+			memcpy(game->distances, racers[i].game.distances, size);
+		}
+	}
+
+	if (game->distances == NULL)
+		game_calc_distances(game, config->distance);
+
+	game_do_assignment(game, config->assign);
+}
+
+static void *racer_run(void *data)
+{
+	Racer *racer = data;
+	const Config *config = racer->config;
+
+	racer->solved = config->solver(&racer->game, &racer->solution);
+
+	/* The first one to finish decides, whether it found a solution or not */
+	u32 none = U32_MAX;
+	if (atomic_compare_exchange_strong(racer->winner, &none, racer->id))
+		atomic_store(racer->game.cancel, TRUE);
+
+	return NULL;
+}
+
+/*
+ * Runs every configuration on its own copy of the level on its own thread and
+ * takes the answer of the first one to finish, cancelling the rest. The copies
+ * share the memory limit of the level and stop along with it.
+ */
+bool game_solve_portfolio(Game *game, TrbString *ret)
+{
+	Racer racers[NCONFIGS];
+
+	_Atomic(bool) cancel;
+	atomic_init(&cancel, FALSE);
+
+	_Atomic u32 winner;
+	atomic_init(&winner, U32_MAX);
+
+	for (u32 i = 0; i < NCONFIGS; ++i) {
+		Racer *racer = &racers[i];
+		racer->config = &configs[i];
+		racer->solved = FALSE;
+		racer->winner = &winner;
+		racer->id = i;
+
+		game_copy(&racer->game, game);
+		racer->game.search = configs[i].search;
+		racer->game.threads = 1;
+		racer->game.cancel = &cancel;
+
+		racer_distances(racers, i);
+	}
+
+	/* Copying reads the memory count of the level, which the racers update */
+	for (u32 i = 0; i < NCONFIGS; ++i)
+		pthread_create(&racers[i].thread, NULL, racer_run, &racers[i]);
+
+	for (u32 i = 0; i < NCONFIGS; ++i)
+		pthread_join(racers[i].thread, NULL);
+
+	u32 first = atomic_load(&winner);
+	bool solved = racers[first].solved;
+
+	/* The racers have given their memory back, so running out is passed on */
+	if (!solved && atomic_load(&racers[first].game.exhausted))
+		atomic_store(&game->exhausted, TRUE);
+
+	for (u32 i = 0; i < NCONFIGS; ++i) {
+		if (i == first && solved)
+			*ret = racers[i].solution;
+		else if (racers[i].solved)
+			trb_string_destroy(&racers[i].solution);
+
+		/* The work of the losers was done all the same */
+		stats_add(&game->stats, &racers[i].game.stats);
+
+		game_destroy(&racers[i].game);
+	}
+
+	return solved;
+}
@@ -0,0 +1,61 @@
+#ifndef SEARCH_H_K3ZQ8MVA
+#define SEARCH_H_K3ZQ8MVA
+
+#include "Assign.h"
+#include "Definitions.h"
+#include "Game.h"
+#include "Pool.h"
+
+#include <tribble/tribble.h>
+
+/*
+ * Everything a single run of a solver allocates. The node store holds every
+ * state generated so far, and the positions of all of them come from the
+ * pool, so they are all released at once when the search is over. The
+ * occupancy grid maps squares to the boxes of the state being looked at.
+ * The seen grid and the queue are scratch space for the flood fills.
+ * The statistics are counted per search, so threads never share them.
+ * The bytes charged for the tables of the solver are given back when the
+ * search is destroyed.
+ */
+typedef struct {
+	Game *game;
+	Pool pool;
+	TrbVector nodes;
+	u8 *reach;
+	u32 *occupancy;
+	u8 *seen;
+	point *queue;
+	u8 *key;
+	u32 *costs;
+	HungarianScratch hungarian;
+	GreedyScratch greedy;
+	ClosestScratch closest;
+	Stats stats;
+	usize charged;
+} Search;
+
+typedef struct {
+	u32 total_distance;
+	u32 distance;
+	u32 node;
+} OpenEntry;
+
+Search *search_init(Search *search, Game *game);
+void search_destroy(Search *search);
+void search_charge(Search *search, usize visited, usize extra);
+
+i32 key_cmp(const u8 *a, const u8 *b, u32 *keysize);
+u32 key_hash(const void *key, usize keysize, u32 seed);
+i32 open_pcmp(const OpenEntry *a, const OpenEntry *b);
+
+bool is_solved(Game *game, State *state);
+u8 *game_key(Search *search, State *state);
+u32 game_successors(Search *search, State *state, State *ret);
+u32 game_heuristic(Search *search, State *parent, State *state);
+void game_solution(Search *search, u32 node, TrbString *ret);
+
+bool parallel_astar(Game *game, TrbString *ret);
+bool parallel_bfs(Game *game, TrbString *ret);
+
+#endif /* end of include guard: SEARCH_H_K3ZQ8MVA */
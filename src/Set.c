@@ -0,0 +1,153 @@
+#include "Set.h"
+
+#include "Definitions.h"
+
+#include <assert.h>
+#include <memory.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/* A slot is looked for this far from its home before the set counts as full */
+#define SET_MAX_PROBES 4096
+
+/*
+ * The tag of a slot is empty, busy while its key is being written, or the
+ * upper half of the hash of the key once it is ready. Ready tags always have
+ * the second bit set, so they never look like the other two.
+ */
+enum {
+	SLOT_EMPTY,
+	SLOT_BUSY,
+};
+
+static u64 set_hash(const u8 *key)
+{
+	u64 hash;
+	memcpy(&hash, key, sizeof hash);
+
+	return hash;
+}
+
+static _Atomic u32 *slot_tag(Set *set, usize i)
+{
+	return (_Atomic u32 *) (set->slots + i * set->stride);
+}
+
+static u8 *slot_key(Set *set, usize i)
+{
+	return set->slots + i * set->stride + sizeof(u32);
+}
+
+Set *set_init(Set *set, u32 keysize, usize memory)
+{
+	set->keysize = keysize;
+	set->stride = (sizeof(u32) + keysize + sizeof(u32) - 1) & ~(sizeof(u32) - 1);
+
+	/* The capacity is a power of two, so that probing can wrap with a mask */
+	usize slots = memory / set->stride;
+	set->capacity = 1024;
+
+	while (set->capacity * 2 <= slots)
+		set->capacity *= 2;
+
+	/* Untouched pages of a zeroed allocation are never backed by memory */
+	set->slots = calloc(set->capacity, set->stride);
+	assert(set->slots != NULL);
+
+	return set;
+}
+
+/*
+ * Adds the key unless it is already there. Returns SET_FULL when no free slot
+ * is found near the home of the key, in which case nothing is added.
+ */
+int set_insert(Set *set, const u8 *key)
+{
+	u64 hash = set_hash(key);
+	u32 tag = (hash >> 32) | 2;
+	usize mask = set->capacity - 1;
+	usize i = hash & mask;
+
+	for (u32 probes = 0; probes < SET_MAX_PROBES; ++probes, i = (i + 1) & mask) {
+		_Atomic u32 *slot = slot_tag(set, i);
+		u32 current = atomic_load_explicit(slot, memory_order_acquire);
+
+		if (current == SLOT_EMPTY) {
+			if (atomic_compare_exchange_strong_explicit(slot, &current, SLOT_BUSY, memory_order_acquire, memory_order_acquire)) {
+				memcpy(slot_key(set, i), key, set->keysize);
+				atomic_store_explicit(slot, tag, memory_order_release);
+				return SET_ADDED;
+			}
+		}
+
+		/* Another thread is writing its key here, which may be this one */
+		while (current == SLOT_BUSY)
+			current = atomic_load_explicit(slot, memory_order_acquire);
+
+		if (current == tag && memcmp(slot_key(set, i), key, set->keysize) == 0)
+			return SET_PRESENT;
+	}
+
+	return SET_FULL;
+}
+
+bool set_contains(Set *set, const u8 *key)
+{
+	u64 hash = set_hash(key);
+	u32 tag = (hash >> 32) | 2;
+	usize mask = set->capacity - 1;
+	usize i = hash & mask;
+
+	for (u32 probes = 0; probes < SET_MAX_PROBES; ++probes, i = (i + 1) & mask) {
+		_Atomic u32 *slot = slot_tag(set, i);
+		u32 current = atomic_load_explicit(slot, memory_order_acquire);
+
+		if (current == SLOT_EMPTY)
+			return FALSE;
+
+		while (current == SLOT_BUSY)
+			current = atomic_load_explicit(slot, memory_order_acquire);
+
+		if (current == tag && memcmp(slot_key(set, i), key, set->keysize) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Moves the keys into a set of the given capacity, or leaves the set as it was if they don't fit */
+static bool set_rehash(Set *set, usize capacity)
+{
+	Set grown = *set;
+	grown.capacity = capacity;
+	grown.slots = calloc(capacity, set->stride);
+	assert(grown.slots != NULL);
+
+	for (usize i = 0; i < set->capacity; ++i) {
+		u32 tag = atomic_load_explicit(slot_tag(set, i), memory_order_relaxed);
+
+		if (tag != SLOT_EMPTY && set_insert(&grown, slot_key(set, i)) == SET_FULL) {
+			free(grown.slots);
+			return FALSE;
+		}
+	}
+
+	free(set->slots);
+	*set = grown;
+
+	return TRUE;
+}
+
+/* Doubles the capacity, more than once in the unlikely case the keys still crowd somewhere */
+void set_grow(Set *set)
+{
+	usize capacity = set->capacity * 2;
+
+	while (!set_rehash(set, capacity))
+		capacity *= 2;
+}
+
+void set_destroy(Set *set)
+{
+	free(set->slots);
+}
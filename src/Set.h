@@ -0,0 +1,32 @@
+#ifndef SET_H_N4FY6QJT
+#define SET_H_N4FY6QJT
+
+#include "Definitions.h"
+
+/*
+ * Set of state keys shared by threads. The slots live in one array sized up
+ * front from a memory budget and are claimed with a compare-and-swap on their
+ * tag, so inserting never takes a lock. Keys have to start with a 64-bit
+ * hash, as the keys of the game do. Growing the set moves every key, so it
+ * may only happen while no other thread uses it.
+ */
+typedef struct {
+	u32 keysize;
+	usize stride;
+	usize capacity;
+	u8 *slots;
+} Set;
+
+enum {
+	SET_ADDED,
+	SET_PRESENT,
+	SET_FULL,
+};
+
+Set *set_init(Set *set, u32 keysize, usize memory);
+int set_insert(Set *set, const u8 *key);
+bool set_contains(Set *set, const u8 *key);
+void set_grow(Set *set);
+void set_destroy(Set *set);
+
+#endif /* end of include guard: SET_H_N4FY6QJT */
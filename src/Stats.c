@@ -0,0 +1,112 @@
+#include "Stats.h"
+
+#include "Definitions.h"
+
+#include <memory.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+void stats_init(Stats *stats)
+{
+	memset(stats, 0, sizeof *stats);
+}
+
+void stats_add(Stats *stats, const Stats *other)
+{
+	stats->generated += other->generated;
+	stats->expanded += other->expanded;
+	stats->duplicates += other->duplicates;
+	stats->evaluations += other->evaluations;
+	stats_peak(&stats->peak_open, other->peak_open);
+	stats_peak(&stats->peak_visited, other->peak_visited);
+
+	stats->parse_time += other->parse_time;
+	stats->patterns_time += other->patterns_time;
+	stats->distances_time += other->distances_time;
+	stats->assignment_time += other->assignment_time;
+	stats->search_time += other->search_time;
+}
+
+void stats_peak(u64 *peak, u64 value)
+{
+	if (value > *peak)
+		*peak = value;
+}
+
+/* The peak resident set of the whole process in KiB */
+static long peak_rss(void)
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+	return usage.ru_maxrss;
+}
+
+static void json_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+
+	for (; str != NULL && *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if ((u8) *str < 0x20)
+			fprintf(out, "\\u%04x", *str);
+		else
+			fputc(*str, out);
+	}
+
+	fputc('"', out);
+}
+
+static void csv_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+
+	for (; str != NULL && *str; ++str) {
+		if (*str == '"')
+			fputc('"', out);
+		fputc(*str, out);
+	}
+
+	fputc('"', out);
+}
+
+void stats_header(FILE *out, int format)
+{
+	if (format != CSV_FORMAT)
+		return;
+
+	fprintf(out, "name,title,status,length,generated,expanded,duplicates,evaluations,peak_open,peak_visited,"
+				 "parse_time,patterns_time,distances_time,assignment_time,search_time,peak_rss_kib\n");
+}
+
+/* Prints one run as a JSON object on a single line, or as a CSV row */
+void stats_print(FILE *out, int format, const char *name, const char *title, const char *status, usize length, const Stats *stats)
+{
+	if (format == JSON_FORMAT) {
+		fprintf(out, "{\"name\": ");
+		json_string(out, name);
+		fprintf(out, ", \"title\": ");
+		json_string(out, title);
+		fprintf(out, ", \"status\": ");
+		json_string(out, status);
+		fprintf(out, ", \"length\": %zu", length);
+		fprintf(out, ", \"generated\": %lu, \"expanded\": %lu, \"duplicates\": %lu, \"evaluations\": %lu",
+			stats->generated, stats->expanded, stats->duplicates, stats->evaluations);
+		fprintf(out, ", \"peak_open\": %lu, \"peak_visited\": %lu", stats->peak_open, stats->peak_visited);
+		fprintf(out, ", \"time\": {\"parse\": %.6f, \"patterns\": %.6f, \"distances\": %.6f, \"assignment\": %.6f, \"search\": %.6f}",
+			stats->parse_time, stats->patterns_time, stats->distances_time, stats->assignment_time, stats->search_time);
+		fprintf(out, ", \"peak_rss_kib\": %ld}\n", peak_rss());
+	} else if (format == CSV_FORMAT) {
+		csv_string(out, name);
+		fputc(',', out);
+		csv_string(out, title);
+		fputc(',', out);
+		csv_string(out, status);
+		fprintf(out, ",%zu,%lu,%lu,%lu,%lu,%lu,%lu", length, stats->generated, stats->expanded, stats->duplicates,
+			stats->evaluations, stats->peak_open, stats->peak_visited);
+		fprintf(out, ",%.6f,%.6f,%.6f,%.6f,%.6f,%ld\n", stats->parse_time, stats->patterns_time, stats->distances_time,
+			stats->assignment_time, stats->search_time, peak_rss());
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef STATS_H_H5VJ2QNB
+#define STATS_H_H5VJ2QNB
+
+#include "Definitions.h"
+
+#include <stdio.h>
+
+/*
+ * What a run of a solver did and where its time went. Every search counts
+ * on its own and adds its counts to the game when it is destroyed. The peaks
+ * of searches running side by side are not added up: the game keeps the
+ * largest of them.
+ */
+typedef struct {
+	u64 generated;
+	u64 expanded;
+	u64 duplicates;
+	u64 evaluations;
+	u64 peak_open;
+	u64 peak_visited;
+
+	double parse_time;
+	double patterns_time;
+	double distances_time;
+	double assignment_time;
+	double search_time;
+} Stats;
+
+enum {
+	TEXT_FORMAT,
+	JSON_FORMAT,
+	CSV_FORMAT,
+};
+
+void stats_init(Stats *stats);
+void stats_add(Stats *stats, const Stats *other);
+void stats_peak(u64 *peak, u64 value);
+
+void stats_header(FILE *out, int format);
+void stats_print(FILE *out, int format, const char *name, const char *title, const char *status, usize length, const Stats *stats);
+
+#endif /* end of include guard: STATS_H_H5VJ2QNB */
@@ -0,0 +1,544 @@
+#include "Batch.h"
+#include "Definitions.h"
+#include "Game.h"
+#include "Level.h"
+#include "Stats.h"
+
+#include <assert.h>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <tribble/tribble.h>
+#include <unistd.h>
+
+/*
+ * A combination of settings to measure. Solvers that don't estimate the
+ * remaining pushes have no distance metric and are measured once. The
+ * solutions and counts of a raced solver depend on which thread wins, so
+ * only its time and memory can be compared.
+ */
+typedef struct {
+	char name[64];
+	bool (*solver)(Game *game, TrbString *ret);
+	int distance;
+	int assign;
+	bool raced;
+} Config;
+
+typedef struct {
+	const char *name;
+	bool (*solver)(Game *game, TrbString *ret);
+	bool raced;
+} Solver;
+
+typedef struct {
+	const char *name;
+	int type;
+} Setting;
+
+static const Solver informed[] = {
+	{ "astar",   game_solve_astar,   FALSE },
+	{ "cbfs",    game_solve_cbfs,    FALSE },
+	{ "idastar", game_solve_idastar, FALSE },
+};
+
+static const Solver uninformed[] = {
+	{ "dfs",       game_solve_dfs,       FALSE },
+	{ "bidir",     game_solve_bidir,     FALSE },
+	{ "portfolio", game_solve_portfolio, TRUE  },
+};
+
+static const Setting metrics[] = {
+	{ "goal_pull",   PULL_GOAL_DIST   },
+	{ "manhattan",   MANHATTAN_DIST   },
+	{ "pythagorean", PYTHAGOREAN_DIST },
+};
+
+static const Setting assignments[] = {
+	{ "hungarian", HUNGARIAN_ASSIGN },
+	{ "greedy",    GREEDY_ASSIGN    },
+	{ "closest",   CLOSEST_ASSIGN   },
+};
+
+#define LENGTH(array) (sizeof array / sizeof *array)
+
+typedef struct {
+	u32 repetitions;
+	double time_limit;
+	usize memory_limit;
+	usize memory;
+	double tolerance;
+	const char *filter;
+} Options;
+
+/* What a single run reports back to the benchmark from its own process */
+typedef struct {
+	bool solved;
+	char status[16];
+	usize length;
+	double seconds;
+	Stats stats;
+} Run;
+
+/* The summary of all runs of a configuration on a level, as kept in baselines */
+typedef struct {
+	char level[256];
+	char config[64];
+	char status[16];
+	usize length;
+	u64 expanded;
+	double median;
+	double mean;
+	double stddev;
+	double min;
+	double rate;
+	long rss;
+} Result;
+
+static i32 cmp_doubles(const double *a, const double *b)
+{
+	if (*a < *b)
+		return -1;
+	if (*a > *b)
+		return 1;
+	return 0;
+}
+
+static void add_configs(TrbVector *configs, const char *filter)
+{
+	for (u32 s = 0; s < LENGTH(informed); ++s) {
+		for (u32 m = 0; m < LENGTH(metrics); ++m) {
+			for (u32 a = 0; a < LENGTH(assignments); ++a) {
+				Config config = { .solver = informed[s].solver, .distance = metrics[m].type, .assign = assignments[a].type };
+				snprintf(config.name, sizeof config.name, "%s/%s/%s", informed[s].name, metrics[m].name, assignments[a].name);
+
+				if (filter == NULL || strstr(config.name, filter) != NULL)
+					trb_vector_push_back(configs, &config);
+			}
+		}
+	}
+
+	for (u32 s = 0; s < LENGTH(uninformed); ++s) {
+		Config config = { .solver = uninformed[s].solver, .distance = -1, .assign = HUNGARIAN_ASSIGN, .raced = uninformed[s].raced };
+		snprintf(config.name, sizeof config.name, "%s", uninformed[s].name);
+
+		if (filter == NULL || strstr(config.name, filter) != NULL)
+			trb_vector_push_back(configs, &config);
+	}
+}
+
+/*
+ * Solves the level in a child process, so that every run starts from the
+ * same heap and its peak memory can be told apart from the others. A run
+ * that dies or overruns its time limit by far is reported as an error.
+ */
+static bool run_once(Game *game, const Config *config, const Options *options, Run *run, long *rss)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		return FALSE;
+
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return FALSE;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+
+		if (options->time_limit > 0)
+			alarm((u32) ceil(options->time_limit) + 5);
+
+		Run result;
+		memset(&result, 0, sizeof result);
+
+		game->search = PUSH_SEARCH;
+		game->memory = options->memory;
+		game->memory_limit = options->memory_limit;
+
+		u64 start = game_clock();
+
+		if (options->time_limit > 0)
+			game->deadline = start + (u64) (options->time_limit * 1e9);
+
+		if (config->distance != -1) {
+			u64 mark = game_clock();
+			game_calc_distances(game, config->distance);
+			game->stats.distances_time = (game_clock() - mark) / 1e9;
+
+			mark = game_clock();
+			game_do_assignment(game, config->assign);
+			game->stats.assignment_time = (game_clock() - mark) / 1e9;
+		}
+
+		u64 mark = game_clock();
+
+		TrbString solution;
+		result.solved = config->solver(game, &solution);
+
+		u64 end = game_clock();
+		game->stats.search_time = (end - mark) / 1e9;
+
+		if (result.solved)
+			result.length = solution.len;
+
+		snprintf(result.status, sizeof result.status, "%s", game_outcome(game, result.solved));
+		result.seconds = (end - start) / 1e9;
+		result.stats = game->stats;
+
+		bool written = write(fds[1], &result, sizeof result) == sizeof result;
+		_exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	close(fds[1]);
+
+	usize got = 0;
+	while (got < sizeof *run) {
+		ssize_t n = read(fds[0], (u8 *) run + got, sizeof *run - got);
+		if (n <= 0)
+			break;
+
+		got += n;
+	}
+
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+
+	if (wait4(pid, &status, 0, &usage) < 0)
+		return FALSE;
+
+	*rss = usage.ru_maxrss;
+
+	return got == sizeof *run && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/*
+ * Runs a configuration on a level the given number of times. The counts of
+ * the search don't change between runs, so only the times and memory are
+ * summarised.
+ */
+static void measure(Game *game, const char *level, const Config *config, const Options *options, Result *result)
+{
+	u32 n = options->repetitions;
+	double seconds[n];
+	double search_time = 0;
+
+	memset(result, 0, sizeof *result);
+	snprintf(result->level, sizeof result->level, "%s", level);
+	snprintf(result->config, sizeof result->config, "%s", config->name);
+	snprintf(result->status, sizeof result->status, "error");
+
+	u32 runs = 0;
+
+	for (u32 i = 0; i < n; ++i) {
+		Run run;
+		long rss;
+
+		if (!run_once(game, config, options, &run, &rss))
+			break;
+
+		if (runs == 0) {
+			snprintf(result->status, sizeof result->status, "%s", run.status);
+			result->length = run.length;
+			result->expanded = run.stats.expanded;
+		}
+
+		seconds[runs++] = run.seconds;
+		search_time += run.stats.search_time;
+
+		if (rss > result->rss)
+			result->rss = rss;
+
+		/* Repeating a run that hit a limit would only hit it again */
+		if (!run.solved)
+			break;
+	}
+
+	if (runs == 0)
+		return;
+
+	double sum = 0;
+	for (u32 i = 0; i < runs; ++i)
+		sum += seconds[i];
+
+	result->mean = sum / runs;
+
+	double squares = 0;
+	for (u32 i = 0; i < runs; ++i)
+		squares += (seconds[i] - result->mean) * (seconds[i] - result->mean);
+
+	result->stddev = runs > 1 ? sqrt(squares / (runs - 1)) : 0;
+
+	qsort(seconds, runs, sizeof(double), (TrbCmpFunc) cmp_doubles);
+
+	result->min = seconds[0];
+	result->median = runs % 2 == 1 ? seconds[runs / 2] : (seconds[runs / 2 - 1] + seconds[runs / 2]) / 2;
+	result->rate = search_time > 0 ? result->expanded * runs / search_time : 0;
+}
+
+static void print_result(FILE *out, const Result *result)
+{
+	fprintf(out, "%s\t%s\t%s\t%zu\t%lu\t%.6f\t%.6f\t%.6f\t%.6f\t%.0f\t%ld", result->level, result->config, result->status,
+		result->length, result->expanded, result->median, result->mean, result->stddev, result->min, result->rate, result->rss);
+}
+
+/* Reads a baseline saved by an earlier run, skipping the header and anything malformed */
+static void load_baseline(TrbVector *baseline, const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open the baseline %s!\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	char line[1024];
+
+	while (fgets(line, sizeof line, file) != NULL) {
+		if (line[0] == '#')
+			continue;
+
+		Result result;
+		memset(&result, 0, sizeof result);
+
+		int fields = sscanf(line, "%255[^\t]\t%63[^\t]\t%15[^\t]\t%zu\t%lu\t%lf\t%lf\t%lf\t%lf\t%lf\t%ld", result.level,
+			result.config, result.status, &result.length, &result.expanded, &result.median, &result.mean,
+			&result.stddev, &result.min, &result.rate, &result.rss);
+
+		if (fields == 11)
+			trb_vector_push_back(baseline, &result);
+	}
+
+	fclose(file);
+}
+
+static Result *find_baseline(TrbVector *baseline, const Result *result)
+{
+	for (usize i = 0; i < baseline->len; ++i) {
+		Result *old = trb_vector_ptr(baseline, Result, i);
+
+		if (strcmp(old->level, result->level) == 0 && strcmp(old->config, result->config) == 0)
+			return old;
+	}
+
+	return NULL;
+}
+
+/*
+ * Tells whether the result got worse than its baseline. Losing a solution,
+ * finding a longer one or expanding more states is always a regression. A
+ * slower run has to stand out of the noise of both measurements as well.
+ */
+static const char *compare(const Result *result, const Result *old, bool raced, double tolerance)
+{
+	if (old == NULL)
+		return "new";
+
+	bool was_solved = strcmp(old->status, "solved") == 0;
+	bool is_solved = strcmp(result->status, "solved") == 0;
+
+	if (was_solved && !is_solved)
+		return "REGRESSION:unsolved";
+	if (!was_solved)
+		return is_solved ? "improved" : "same";
+
+	if (!raced && result->length > old->length)
+		return "REGRESSION:length";
+	if (!raced && result->expanded > old->expanded * (1 + tolerance))
+		return "REGRESSION:nodes";
+
+	double noise = 2 * (result->stddev + old->stddev) + 1e-3;
+
+	if (result->median > old->median * (1 + tolerance) && result->median - old->median > noise)
+		return "REGRESSION:time";
+	if (result->rss > old->rss * (1 + tolerance) && result->rss - old->rss > 1024)
+		return "REGRESSION:memory";
+
+	if (result->median < old->median * (1 - tolerance) && old->median - result->median > noise)
+		return "improved";
+
+	return "same";
+}
+
+/*
+ * Measures every configuration on every level found in the given files and
+ * directories. One line is printed per level and configuration: the median,
+ * mean, standard deviation and minimum of the wall-clock seconds, the states
+ * expanded per second of search and the peak memory of the run in KiB.
+ */
+int main(int argc, char *argv[])
+{
+	Options options = {
+		.repetitions = 5,
+		.time_limit = 10,
+		.memory_limit = 0,
+		.memory = 64 << 20,
+		.tolerance = 0.1,
+		.filter = NULL,
+	};
+
+	const char *baseline_file = NULL;
+	const char *save_file = NULL;
+
+	int choice;
+	while (1) {
+		static struct option long_options[] = {
+			{"repeat",        required_argument, 0, 'r'},
+			{ "time-limit",   required_argument, 0, 'T'},
+			{ "memory-limit", required_argument, 0, 'L'},
+			{ "memory",       required_argument, 0, 'M'},
+			{ "config",       required_argument, 0, 'c'},
+			{ "baseline",     required_argument, 0, 'b'},
+			{ "save",         required_argument, 0, 's'},
+			{ "tolerance",    required_argument, 0, 't'},
+			{ "help",         no_argument,       0, 'h'},
+
+			{ 0,              0,                 0, 0  }
+		};
+
+		int option_index = 0;
+
+		choice = getopt_long(argc, argv, "r:T:L:M:c:b:s:t:h", long_options, &option_index);
+		if (choice == -1)
+			break;
+
+		switch (choice) {
+		case 'h':
+			printf("%s: [options] [files and directories of levels]\n", argv[0]);
+			printf("\nEvery solver, distance metric and assignment is run on every level, levels/ by default.\n");
+			printf("\nOptions:\n");
+			printf(" -r, --repeat <N>\tRuns of every configuration on every level, 5 by default\n");
+			printf(" -T, --time-limit <s>\tGive up on a run after this many seconds, 10 by default\n");
+			printf(" -L, --memory-limit <MiB>\tGive up on a run once its search takes this much memory\n");
+			printf(" -M, --memory <MiB>\tSize of the IDA* transposition table\n");
+			printf(" -c, --config <text>\tOnly run the configurations whose name contains the text\n");
+			printf(" -b, --baseline <file>\tCompare with the results saved in the file\n");
+			printf(" -s, --save <file>\tSave the results as a baseline\n");
+			printf(" -t, --tolerance <%%>\tChange allowed before a result counts as a regression, 10 by default\n");
+			return 0;
+		case 'r': options.repetitions = strtoul(optarg, NULL, 10); break;
+		case 'T': options.time_limit = strtod(optarg, NULL); break;
+		case 'L': options.memory_limit = strtoul(optarg, NULL, 10) << 20; break;
+		case 'M': options.memory = strtoul(optarg, NULL, 10) << 20; break;
+		case 'c': options.filter = optarg; break;
+		case 'b': baseline_file = optarg; break;
+		case 's': save_file = optarg; break;
+		case 't': options.tolerance = strtod(optarg, NULL) / 100; break;
+		default: exit(EXIT_FAILURE);
+		}
+	}
+
+	if (options.repetitions == 0)
+		options.repetitions = 1;
+
+	TrbVector configs;
+	trb_vector_init(&configs, FALSE, sizeof(Config));
+	add_configs(&configs, options.filter);
+
+	TrbVector files;
+	trb_vector_init(&files, FALSE, sizeof(char *));
+
+	if (optind == argc)
+		batch_files(&files, "levels");
+
+	for (int i = optind; i < argc; ++i)
+		batch_files(&files, argv[i]);
+
+	TrbVector baseline;
+	trb_vector_init(&baseline, FALSE, sizeof(Result));
+
+	if (baseline_file != NULL)
+		load_baseline(&baseline, baseline_file);
+
+	FILE *save = NULL;
+
+	if (save_file != NULL) {
+		save = fopen(save_file, "w");
+
+		if (save == NULL) {
+			fprintf(stderr, "Couldn't create %s!\n", save_file);
+			exit(EXIT_FAILURE);
+		}
+
+		fprintf(save, "#level\tconfig\tstatus\tlength\texpanded\tmedian\tmean\tstddev\tmin\tnodes/s\trss_kib\n");
+	}
+
+	printf("#level\tconfig\tstatus\tlength\texpanded\tmedian\tmean\tstddev\tmin\tnodes/s\trss_kib\tverdict\n");
+
+	u32 regressions = 0;
+
+	for (usize f = 0; f < files.len; ++f) {
+		const char *filename = trb_vector_get(&files, char *, f);
+
+		Pack pack;
+		if (!pack_open(&pack, filename)) {
+			fprintf(stderr, "Couldn't read %s!\n", filename);
+			continue;
+		}
+
+		Game game;
+		int next;
+
+		while ((next = pack_next(&pack, &game)) != PACK_END) {
+			if (next == PACK_INVALID)
+				continue;
+
+			char level[256];
+			if (pack.sized)
+				snprintf(level, sizeof level, "%s", filename);
+			else
+				snprintf(level, sizeof level, "%s:%u", filename, pack.count);
+
+			/* The patterns don't depend on the configuration, so every run inherits them */
+			game_calc_patterns(&game, NULL);
+
+			for (usize c = 0; c < configs.len; ++c) {
+				Config *config = trb_vector_ptr(&configs, Config, c);
+
+				Result result;
+				measure(&game, level, config, &options, &result);
+
+				const char *verdict = compare(&result, find_baseline(&baseline, &result), config->raced, options.tolerance);
+				if (strncmp(verdict, "REGRESSION", 10) == 0)
+					regressions++;
+
+				print_result(stdout, &result);
+				printf("\t%s\n", baseline_file != NULL ? verdict : "-");
+				fflush(stdout);
+
+				if (save != NULL) {
+					print_result(save, &result);
+					fputc('\n', save);
+				}
+			}
+
+			game_destroy(&game);
+		}
+
+		pack_close(&pack);
+	}
+
+	if (save != NULL)
+		fclose(save);
+
+	for (usize i = 0; i < files.len; ++i)
+		free(trb_vector_get(&files, char *, i));
+
+	trb_vector_destroy(&files, NULL);
+	trb_vector_destroy(&configs, NULL);
+	trb_vector_destroy(&baseline, NULL);
+
+	if (baseline_file != NULL)
+		fprintf(stderr, "%u regressions\n", regressions);
+
+	return regressions != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
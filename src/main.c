@@ -1,7 +1,10 @@
 #include "Assign.h"
+#include "Batch.h"
 #include "Definitions.h"
 #include "Distance.h"
 #include "Game.h"
+#include "Level.h"
+#include "Stats.h"
 
 #include <assert.h>
 #include <getopt.h>
@@ -10,6 +13,7 @@
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/timerfd.h>
 #include <time.h>
 #include <tribble/tribble.h>
@@ -231,30 +235,49 @@ void visual_push(Game *game, u32 old_x, u32 old_y, u32 new_x, u32 new_y)
 int main(int argc, char *argv[])
 {
 	char *filename = NULL;
-	bool (*solver)(Game * game, State * ret) = NULL;
+	bool (*solver)(Game * game, TrbString * ret) = NULL;
 	int distance_metric = -1;
 	int assignment_alg = -1;
+	int search = MOVE_SEARCH;
+	usize memory = 0;
+	u32 threads = 0;
+	bool batch = FALSE;
+	double time_limit = 0;
+	usize memory_limit = 0;
+	u32 index = 1;
+	int format = TEXT_FORMAT;
 
 	int choice;
 	while (1) {
 		static struct option long_options[] = {
-			{"astar",        no_argument, 0, 'a'},
-			{ "cbfs",        no_argument, 0, 'c'},
-			{ "dfs",         no_argument, 0, 'd'},
-			{ "help",        no_argument, 0, 'h'},
-			{ "hungarian",   no_argument, 0, 'H'},
-			{ "greedy",      no_argument, 0, 'G'},
-			{ "closest",     no_argument, 0, 'C'},
-			{ "goal_pull",   no_argument, 0, 'g'},
-			{ "manhattan",   no_argument, 0, 'm'},
-			{ "pythagorean", no_argument, 0, 'p'},
-
-			{ 0,             0,           0, 0  }
+			{"astar",         no_argument,       0, 'a'},
+			{ "bidir",        no_argument,       0, 'b'},
+			{ "cbfs",         no_argument,       0, 'c'},
+			{ "dfs",          no_argument,       0, 'd'},
+			{ "portfolio",    no_argument,       0, 'f'},
+			{ "help",         no_argument,       0, 'h'},
+			{ "idastar",      no_argument,       0, 'i'},
+			{ "hungarian",    no_argument,       0, 'H'},
+			{ "greedy",       no_argument,       0, 'G'},
+			{ "closest",      no_argument,       0, 'C'},
+			{ "goal_pull",    no_argument,       0, 'g'},
+			{ "manhattan",    no_argument,       0, 'm'},
+			{ "pythagorean",  no_argument,       0, 'p'},
+			{ "push",         no_argument,       0, 'P'},
+			{ "memory",       required_argument, 0, 'M'},
+			{ "threads",      required_argument, 0, 'j'},
+			{ "batch",        no_argument,       0, 'B'},
+			{ "time-limit",   required_argument, 0, 'T'},
+			{ "memory-limit", required_argument, 0, 'L'},
+			{ "level",        required_argument, 0, 'l'},
+			{ "format",       required_argument, 0, 'F'},
+
+			{ 0,              0,                 0, 0  }
 		};
 
 		int option_index = 0;
 
-		choice = getopt_long(argc, argv, "acdhGCHgmp", long_options, &option_index);
+		choice = getopt_long(argc, argv, "abcdfhiGCHgmpPM:j:BT:L:l:F:", long_options, &option_index);
 		if (choice == -1)
 			break;
 
@@ -264,7 +287,23 @@ int main(int argc, char *argv[])
 			printf("\nSolvers:\n");
 			printf(" -c, --cbfs \tComplete Best First Search algorithm\n");
 			printf(" -a, --astar\tA* Search algorithm\n");
+			printf(" -i, --idastar\tIterative Deepening A* algorithm\n");
 			printf(" -d, --dfs  \tDepth First Search algorithm\n");
+			printf(" -b, --bidir\tBidirectional push and pull search\n");
+			printf(" -f, --portfolio\tRace several solver configurations on separate threads\n");
+			printf("\nSearch modes:\n");
+			printf(" -P, --push \tSearch over box pushes instead of single moves\n");
+			printf("\nLimits:\n");
+			printf(" -M, --memory <MiB>\tSize of the IDA* transposition table and initial size of the parallel visited set\n");
+			printf(" -j, --threads <N>\tNumber of A* and DFS worker threads, or of levels solved at once in a batch\n");
+			printf(" -T, --time-limit <s>\tGive up on a level after this many seconds\n");
+			printf(" -L, --memory-limit <MiB>\tGive up on a level once its search takes this much memory\n");
+			printf("\nBatch:\n");
+			printf(" -B, --batch\tSolve every level in the given files and directories, one line per level\n");
+			printf("\nPacks:\n");
+			printf(" -l, --level <N>\tSolve the level with this number in a pack of levels\n");
+			printf("\nOutput:\n");
+			printf(" -F, --format <text|json|csv>\tPrint the result with the counts and timings of the search\n");
 			printf("\nDistance metrics:\n");
 			printf(" -g, --goal_pull  \tGoal Pull\n");
 			printf(" -m, --manhattan  \tManhattan\n");
@@ -275,14 +314,36 @@ int main(int argc, char *argv[])
 			printf(" -H, --hungarian\tHungarian\n");
 			return 0;
 		case 'a': solver = game_solve_astar; break;
+		case 'b': solver = game_solve_bidir; break;
 		case 'c': solver = game_solve_cbfs; break;
 		case 'd': solver = game_solve_dfs; break;
+		case 'f': solver = game_solve_portfolio; break;
 		case 'g': distance_metric = PULL_GOAL_DIST; break;
 		case 'm': distance_metric = MANHATTAN_DIST; break;
 		case 'p': distance_metric = PYTHAGOREAN_DIST; break;
 		case 'G': assignment_alg = GREEDY_ASSIGN; break;
 		case 'C': assignment_alg = CLOSEST_ASSIGN; break;
 		case 'H': assignment_alg = HUNGARIAN_ASSIGN; break;
+		case 'P': search = PUSH_SEARCH; break;
+		case 'i': solver = game_solve_idastar; break;
+		case 'M': memory = strtoul(optarg, NULL, 10) << 20; break;
+		case 'j': threads = strtoul(optarg, NULL, 10); break;
+		case 'B': batch = TRUE; break;
+		case 'T': time_limit = strtod(optarg, NULL); break;
+		case 'L': memory_limit = strtoul(optarg, NULL, 10) << 20; break;
+		case 'l': index = strtoul(optarg, NULL, 10); break;
+		case 'F':
+			if (strcmp(optarg, "text") == 0) {
+				format = TEXT_FORMAT;
+			} else if (strcmp(optarg, "json") == 0) {
+				format = JSON_FORMAT;
+			} else if (strcmp(optarg, "csv") == 0) {
+				format = CSV_FORMAT;
+			} else {
+				fprintf(stderr, "Unknown output format %s!\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		default: exit(EXIT_FAILURE);
 		}
 	}
@@ -299,58 +360,98 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	if (solver != game_solve_dfs && distance_metric == -1) {
+	bool informed = solver != game_solve_dfs && solver != game_solve_bidir && solver != game_solve_portfolio;
+
+	if (informed && distance_metric == -1) {
 		fprintf(stderr, "No distance metric specified!\n");
 		exit(EXIT_FAILURE);
 	}
 
-	if (solver != game_solve_dfs && assignment_alg == -1) {
+	if (informed && assignment_alg == -1) {
 		fprintf(stderr, "No assignment algorithm specified!\n");
 		exit(EXIT_FAILURE);
 	}
 
-	FILE *level = fopen(filename, "r");
-	if (level == NULL)
-		handle_error("fopen");
+	if (batch) {
+		BatchOptions options = {
+			.solver = solver,
+			.distance = informed ? distance_metric : -1,
+			.assign = assignment_alg,
+			.search = search,
+			.memory = memory != 0 ? memory : 64 << 20,
+			.workers = threads != 0 ? threads : sysconf(_SC_NPROCESSORS_ONLN),
+			.time_limit = time_limit,
+			.memory_limit = memory_limit,
+			.format = format,
+		};
 
-	u32 w, h;
-	if (fscanf(level, " %u %u", &w, &h) < 2) {
-		fprintf(stderr, "Wrong level format!\n");
-		exit(EXIT_FAILURE);
+		u32 nfiles = argc - optind;
+		batch_solve(argv + optind, nfiles, &options);
+
+		return 0;
 	}
 
-	char(*board)[h][w] = malloc(sizeof *board);
-	assert(board != NULL);
+	u64 mark = game_clock();
 
-	for (u32 y = 0; y < h; ++y) {
-		for (u32 x = 0; x < w;) {
-			int c = fgetc(level);
-			if (c == '\n')
-				continue;
-			(*board)[y][x++] = c;
-		}
+	Game game;
+	if (!level_load(&game, filename, index)) {
+		fprintf(stderr, "Couldn't read level %u from %s!\n", index, filename);
+		exit(EXIT_FAILURE);
 	}
 
-	Game game;
-	game_init(&game);
-	game_parse_board(&game, w, h, (const char *) board);
+	game.stats.parse_time = (game_clock() - mark) / 1e9;
+
+	game.search = search;
+	game.memory_limit = memory_limit;
+
+	if (memory != 0)
+		game.memory = memory;
+
+	if (threads != 0)
+		game.threads = threads;
+
+	mark = game_clock();
+
+	/* The limit covers building the tables as well as the search */
+	if (time_limit > 0)
+		game.deadline = mark + (u64) (time_limit * 1e9);
 
-	if (solver != game_solve_dfs) {
+	level_calc_patterns(&game, filename, index);
+	game.stats.patterns_time = (game_clock() - mark) / 1e9;
+
+	if (informed && !game_out_of_time(&game)) {
+		mark = game_clock();
 		game_calc_distances(&game, distance_metric);
+		game.stats.distances_time = (game_clock() - mark) / 1e9;
+
+		mark = game_clock();
 		game_do_assignment(&game, assignment_alg);
+		game.stats.assignment_time = (game_clock() - mark) / 1e9;
 	}
 
 	clock_t old = clock();
+	mark = game_clock();
 
-	State sol;
-	bool solved = solver(&game, &sol);
+	TrbString sol;
+	bool solved = !game_out_of_time(&game) && solver(&game, &sol);
 
 	clock_t new = clock();
+	game.stats.search_time = (game_clock() - mark) / 1e9;
 
 	double diff = (double) (new - old) / (double) CLOCKS_PER_SEC;
 
-	if (solved) {
-		printf("Length: %lu\n", sol.solution.len);
+	if (format != TEXT_FORMAT) {
+		/* Levels of packs are named as in a batch */
+		char name[strlen(filename) + sizeof ":4294967295"];
+		if (index == 1)
+			sprintf(name, "%s", filename);
+		else
+			sprintf(name, "%s:%u", filename, index);
+
+		stats_header(stdout, format);
+		stats_print(stdout, format, name, NULL, game_outcome(&game, solved), solved ? sol.len : 0, &game.stats);
+	} else if (solved) {
+		printf("Length: %lu\n", sol.len);
 		printf("Processor time: %lf\n", diff);
 	} else {
 		printf("No solution found!\n");
@@ -387,27 +488,27 @@ int main(int argc, char *argv[])
 	printw("Calculating...");
 	refresh();
 
-	if (solver != game_solve_dfs) {
+	if (informed) {
 		game_calc_distances(&game, distance_metric);
 		game_do_assignment(&game, assignment_alg);
 	}
 
-	/* State sol; */
+	/* TrbString sol; */
 	/* bool solved = solver(&game, &sol); */
 
 	clear();
 
 	if (solved) {
 		show_board(&game, &game.state);
-		printw("Length: %lu\n", sol.solution.len);
+		printw("Length: %lu\n", sol.len);
 		printw("Press 'q' or Ctrl-C to exit\n");
 		refresh();
 
 		u32 init_x = game.state.positions[0].x;
 		u32 init_y = game.state.positions[0].y;
 
-		u32 actions_len = sol.solution.len;
-		Action *actions = parse_solution(sol.solution.data, actions_len, init_x, init_y);
+		u32 actions_len = sol.len;
+		Action *actions = parse_solution(sol.data, actions_len, init_x, init_y);
 
 		int tfd = timerfd_create(CLOCK_REALTIME, 0);
 		if (tfd < 0)